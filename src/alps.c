@@ -1421,9 +1421,9 @@ static psmouse_ret_t alps_handle_interleaved_ps2(struct psmouse *psmouse)
 		      psmouse->packet[4] |
 		      psmouse->packet[5]) & 0x80) ||
 		    (!alps_is_valid_first_byte(priv, psmouse->packet[6]))) {
-			psmouse_dbg(psmouse,
-				    "refusing packet %4ph (suspected interleaved ps/2)\n",
-				    psmouse->packet + 3);
+			psmouse_diag(psmouse, PSMOUSE_DIAG_BAD_DATA,
+				     "refusing packet %4ph (suspected interleaved ps/2)\n",
+				     psmouse->packet + 3);
 			return PSMOUSE_BAD_DATA;
 		}
 
@@ -1485,9 +1485,9 @@ static void alps_flush_packet(unsigned long data)
 		if ((psmouse->packet[3] |
 		     psmouse->packet[4] |
 		     psmouse->packet[5]) & 0x80) {
-			psmouse_dbg(psmouse,
-				    "refusing packet %3ph (suspected interleaved ps/2)\n",
-				    psmouse->packet + 3);
+			psmouse_diag(psmouse, PSMOUSE_DIAG_DISCARDED,
+				     "refusing packet %3ph (suspected interleaved ps/2)\n",
+				     psmouse->packet + 3);
 		} else {
 			priv->process_packet(psmouse);
 		}
@@ -1528,9 +1528,9 @@ static psmouse_ret_t alps_process_byte(struct psmouse *psmouse)
 	}
 
 	if (!alps_is_valid_first_byte(priv, psmouse->packet[0])) {
-		psmouse_dbg(psmouse,
-			    "refusing packet[0] = %x (mask0 = %x, byte0 = %x)\n",
-			    psmouse->packet[0], priv->mask0, priv->byte0);
+		psmouse_diag(psmouse, PSMOUSE_DIAG_BAD_DATA,
+			     "refusing packet[0] = %x (mask0 = %x, byte0 = %x)\n",
+			     psmouse->packet[0], priv->mask0, priv->byte0);
 		return PSMOUSE_BAD_DATA;
 	}
 
@@ -1538,9 +1538,10 @@ static psmouse_ret_t alps_process_byte(struct psmouse *psmouse)
 	if (priv->proto_version < ALPS_PROTO_V5 &&
 	    psmouse->pktcnt >= 2 && psmouse->pktcnt <= psmouse->pktsize &&
 	    (psmouse->packet[psmouse->pktcnt - 1] & 0x80)) {
-		psmouse_dbg(psmouse, "refusing packet[%i] = %x\n",
-			    psmouse->pktcnt - 1,
-			    psmouse->packet[psmouse->pktcnt - 1]);
+		psmouse_diag(psmouse, PSMOUSE_DIAG_BAD_DATA,
+			     "refusing packet[%i] = %x\n",
+			     psmouse->pktcnt - 1,
+			     psmouse->packet[psmouse->pktcnt - 1]);
 
 		if (priv->proto_version == ALPS_PROTO_V3_RUSHMORE &&
 		    psmouse->pktcnt == psmouse->pktsize) {
@@ -1563,9 +1564,10 @@ static psmouse_ret_t alps_process_byte(struct psmouse *psmouse)
 			!alps_is_valid_package_v7(psmouse)) ||
 	    (priv->proto_version == ALPS_PROTO_V8 &&
 			!alps_is_valid_package_ss4_v2(psmouse))) {
-		psmouse_dbg(psmouse, "refusing packet[%i] = %x\n",
-			    psmouse->pktcnt - 1,
-			    psmouse->packet[psmouse->pktcnt - 1]);
+		psmouse_diag(psmouse, PSMOUSE_DIAG_BAD_DATA,
+			     "refusing packet[%i] = %x\n",
+			     psmouse->pktcnt - 1,
+			     psmouse->packet[psmouse->pktcnt - 1]);
 		return PSMOUSE_BAD_DATA;
 	}
 
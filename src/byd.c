@@ -21,11 +21,11 @@
 #include <linux/delay.h>
 #include <linux/input.h>
 #include <linux/libps2.h>
+#include <linux/module.h>
 #include <linux/serio.h>
 #include <linux/slab.h>
 
 #include "psmouse.h"
-#include "byd.h"
 
 /* PS2 Bits */
 #define PS2_Y_OVERFLOW	BIT_MASK(7)
@@ -282,8 +282,8 @@ static psmouse_ret_t byd_process_byte(struct psmouse *psmouse)
 	u8 *pkt = psmouse->packet;
 
 	if (psmouse->pktcnt > 0 && !(pkt[0] & PS2_ALWAYS_1)) {
-		psmouse_warn(psmouse, "Always_1 bit not 1. pkt[0] = %02x\n",
-			     pkt[0]);
+		psmouse_diag(psmouse, PSMOUSE_DIAG_BAD_DATA,
+			     "Always_1 bit not 1. pkt[0] = %02x\n", pkt[0]);
 		return PSMOUSE_BAD_DATA;
 	}
 
@@ -320,10 +320,8 @@ static psmouse_ret_t byd_process_byte(struct psmouse *psmouse)
 		break;
 	}
 	default:
-		psmouse_warn(psmouse,
-			     "Unrecognized Z: pkt = %02x %02x %02x %02x\n",
-			     psmouse->packet[0], psmouse->packet[1],
-			     psmouse->packet[2], psmouse->packet[3]);
+		psmouse_diag(psmouse, PSMOUSE_DIAG_BAD_DATA,
+			     "Unrecognized Z: pkt = %4ph\n", psmouse->packet);
 		return PSMOUSE_BAD_DATA;
 	}
 
@@ -437,7 +435,7 @@ static void byd_disconnect(struct psmouse *psmouse)
 	}
 }
 
-int byd_detect(struct psmouse *psmouse, bool set_properties)
+static int byd_detect(struct psmouse *psmouse, bool set_properties)
 {
 	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	u8 param[4] = {0x03, 0x00, 0x00, 0x00};
@@ -466,7 +464,7 @@ int byd_detect(struct psmouse *psmouse, bool set_properties)
 	return 0;
 }
 
-int byd_init(struct psmouse *psmouse)
+static int byd_init(struct psmouse *psmouse)
 {
 	struct input_dev *dev = psmouse->dev;
 	struct byd_data *priv;
@@ -513,3 +511,29 @@ int byd_init(struct psmouse *psmouse)
 
 	return 0;
 }
+
+static const struct psmouse_protocol byd_protocol = {
+	.type		= PSMOUSE_BYD,
+	.name		= "BYDPS/2",
+	.alias		= "byd",
+	.detect		= byd_detect,
+	.init		= byd_init,
+	.owner		= THIS_MODULE,
+};
+
+static int __init byd_module_init(void)
+{
+	return psmouse_register_protocol(&byd_protocol);
+}
+
+static void __exit byd_module_exit(void)
+{
+	psmouse_unregister_protocol(&byd_protocol);
+}
+
+module_init(byd_module_init);
+module_exit(byd_module_exit);
+
+MODULE_DESCRIPTION("BYD TouchPad PS/2 protocol for psmouse");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_PSMOUSE_PROTOCOL("byd");
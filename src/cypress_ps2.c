@@ -22,6 +22,7 @@
 #include <linux/libps2.h>
 #include <linux/input.h>
 #include <linux/input/mt.h>
+#include <linux/ktime.h>
 #include <linux/sched.h>
 #include <linux/wait.h>
 
@@ -169,31 +170,68 @@ static bool cypress_verify_cmd_state(struct psmouse *psmouse,
 	return false;
 }
 
-static int cypress_send_ext_cmd(struct psmouse *psmouse, unsigned char cmd,
-				unsigned char *param)
+/*
+ * One extended command of a batch. 'done' is set once its response has
+ * been read and has passed verification.
+ */
+struct cytp_ext_cmd {
+	unsigned char cmd;
+	unsigned char *param;
+	bool done;
+};
+
+/*
+ * Send a sequence of extended commands, reading each response as we go,
+ * and verify all the responses in one pass at the end. Commands that did
+ * not make it are sent again, in order, on the next try.
+ */
+static int cypress_send_ext_cmds(struct psmouse *psmouse,
+				 struct cytp_ext_cmd *cmds, int n)
 {
 	int tries = CYTP_PS2_CMD_TRIES;
-	int rc;
+	int pending;
+	int i;
 
-	psmouse_dbg(psmouse, "send extension cmd 0x%02x, [%d %d %d %d]\n",
-		 cmd, DECODE_CMD_AA(cmd), DECODE_CMD_BB(cmd),
-		 DECODE_CMD_CC(cmd), DECODE_CMD_DD(cmd));
+	for (i = 0; i < n; i++)
+		cmds[i].done = false;
 
 	do {
-		cypress_ps2_ext_cmd(psmouse,
-				    PSMOUSE_CMD_SETRES, DECODE_CMD_DD(cmd));
-		cypress_ps2_ext_cmd(psmouse,
-				    PSMOUSE_CMD_SETRES, DECODE_CMD_CC(cmd));
-		cypress_ps2_ext_cmd(psmouse,
-				    PSMOUSE_CMD_SETRES, DECODE_CMD_BB(cmd));
-		cypress_ps2_ext_cmd(psmouse,
-				    PSMOUSE_CMD_SETRES, DECODE_CMD_AA(cmd));
-
-		rc = cypress_ps2_read_cmd_status(psmouse, cmd, param);
-		if (rc)
-			continue;
+		for (i = 0; i < n; i++) {
+			unsigned char cmd = cmds[i].cmd;
+
+			if (cmds[i].done)
+				continue;
+
+			psmouse_dbg(psmouse,
+				    "send extension cmd 0x%02x, [%d %d %d %d]\n",
+				    cmd, DECODE_CMD_AA(cmd), DECODE_CMD_BB(cmd),
+				    DECODE_CMD_CC(cmd), DECODE_CMD_DD(cmd));
+
+			cypress_ps2_ext_cmd(psmouse,
+					    PSMOUSE_CMD_SETRES, DECODE_CMD_DD(cmd));
+			cypress_ps2_ext_cmd(psmouse,
+					    PSMOUSE_CMD_SETRES, DECODE_CMD_CC(cmd));
+			cypress_ps2_ext_cmd(psmouse,
+					    PSMOUSE_CMD_SETRES, DECODE_CMD_BB(cmd));
+			cypress_ps2_ext_cmd(psmouse,
+					    PSMOUSE_CMD_SETRES, DECODE_CMD_AA(cmd));
+
+			cmds[i].done = !cypress_ps2_read_cmd_status(psmouse, cmd,
+								    cmds[i].param);
+		}
+
+		pending = 0;
+		for (i = 0; i < n; i++) {
+			if (cmds[i].done &&
+			    !cypress_verify_cmd_state(psmouse, cmds[i].cmd,
+						      cmds[i].param))
+				cmds[i].done = false;
+
+			if (!cmds[i].done)
+				pending++;
+		}
 
-		if (cypress_verify_cmd_state(psmouse, cmd, param))
+		if (!pending)
 			return 0;
 
 	} while (--tries > 0);
@@ -201,6 +239,14 @@ static int cypress_send_ext_cmd(struct psmouse *psmouse, unsigned char cmd,
 	return -EIO;
 }
 
+static int cypress_send_ext_cmd(struct psmouse *psmouse, unsigned char cmd,
+				unsigned char *param)
+{
+	struct cytp_ext_cmd ext = { .cmd = cmd, .param = param };
+
+	return cypress_send_ext_cmds(psmouse, &ext, 1);
+}
+
 int cypress_detect(struct psmouse *psmouse, bool set_properties)
 {
 	unsigned char param[3];
@@ -249,10 +295,14 @@ static int cypress_read_fw_version(struct psmouse *psmouse)
 	return 0;
 }
 
-static int cypress_read_tp_metrics(struct psmouse *psmouse)
+/*
+ * Set up the trackpad metrics, from the response to
+ * CYTP_CMD_READ_TP_METRICS if we got a valid one, or from defaults.
+ */
+static int cypress_parse_tp_metrics(struct psmouse *psmouse,
+				    const unsigned char *param, bool valid)
 {
 	struct cytp_data *cytp = psmouse->private;
-	unsigned char param[8];
 
 	/* set default values for tp metrics. */
 	cytp->tp_width = CYTP_DEFAULT_WIDTH;
@@ -267,8 +317,7 @@ static int cypress_read_tp_metrics(struct psmouse *psmouse)
 	if (!cytp->tp_metrics_supported)
 		return 0;
 
-	memset(param, 0, sizeof(param));
-	if (cypress_send_ext_cmd(psmouse, CYTP_CMD_READ_TP_METRICS, param) == 0) {
+	if (valid) {
 		/* Update trackpad parameters. */
 		cytp->tp_max_abs_x = (param[1] << 8) | param[0];
 		cytp->tp_max_abs_y = (param[3] << 8) | param[2];
@@ -322,34 +371,105 @@ static int cypress_read_tp_metrics(struct psmouse *psmouse)
 	return 0;
 }
 
-static int cypress_query_hardware(struct psmouse *psmouse)
+static int cypress_get_finger_count(unsigned char header_byte)
 {
-	int ret;
+	unsigned char bits6_7;
+	int finger_count;
 
-	ret = cypress_read_fw_version(psmouse);
-	if (ret)
-		return ret;
+	bits6_7 = header_byte >> 6;
+	finger_count = bits6_7 & 0x03;
 
-	ret = cypress_read_tp_metrics(psmouse);
-	if (ret)
-		return ret;
+	if (finger_count == 1)
+		return 1;
 
-	return 0;
+	if (header_byte & ABS_HSCROLL_BIT) {
+		/* HSCROLL gets added on to 0 finger count. */
+		switch (finger_count) {
+			case 0:	return 4;
+			case 2: return 5;
+			default:
+				/* Invalid contact (e.g. palm). Ignore it. */
+				return 0;
+		}
+	}
+
+	return finger_count;
 }
 
-static int cypress_set_absolute_mode(struct psmouse *psmouse)
+/*
+ * Decode every possible header byte once for the current mode, so that
+ * framing a packet only takes a table lookup on its first byte.
+ */
+static void cypress_build_frames(struct cytp_data *cytp)
 {
-	struct cytp_data *cytp = psmouse->private;
-	unsigned char param[3];
+	struct cytp_frame *frame;
+	int contact_cnt;
+	int i;
 
-	if (cypress_send_ext_cmd(psmouse, CYTP_CMD_ABS_WITH_PRESSURE_MODE, param) < 0)
-		return -1;
+	for (i = 0; i < ARRAY_SIZE(cytp->frames); i++) {
+		frame = &cytp->frames[i];
+		contact_cnt = cypress_get_finger_count(i);
+
+		frame->contacts = contact_cnt;
+		frame->flags = 0;
+
+		if ((i & 0xfc) == 0)
+			frame->flags |= CYTP_FRAME_LEAVE;
+		else if ((i & 0x08) == 0x08)
+			frame->flags |= CYTP_FRAME_INVALID;
+
+		if (cytp->mode & CYTP_BIT_ABS_NO_PRESSURE)
+			frame->len = contact_cnt == 2 ? 7 : 4;
+		else
+			frame->len = contact_cnt == 2 ? 8 : 5;
+	}
+}
+
+/*
+ * Bookkeeping once the trackpad has accepted
+ * CYTP_CMD_ABS_WITH_PRESSURE_MODE.
+ */
+static void cypress_absolute_mode_set(struct psmouse *psmouse)
+{
+	struct cytp_data *cytp = psmouse->private;
 
 	cytp->mode = (cytp->mode & ~CYTP_BIT_ABS_REL_MASK)
 			| CYTP_BIT_ABS_PRESSURE;
 	cypress_set_packet_size(psmouse, 5);
+	cypress_build_frames(cytp);
+}
 
-	return 0;
+/*
+ * Query the trackpad and switch it to absolute mode. Once we know the
+ * firmware version, the metrics read (if supported) and the mode switch
+ * always follow each other, so they go out as one batch. Whether the
+ * mode switch worked is left in cytp->mode for the caller to check.
+ */
+static int cypress_query_hardware(struct psmouse *psmouse)
+{
+	struct cytp_data *cytp = psmouse->private;
+	unsigned char metrics[8];
+	unsigned char mode[3];
+	struct cytp_ext_cmd cmds[] = {
+		{ .cmd = CYTP_CMD_READ_TP_METRICS, .param = metrics },
+		{ .cmd = CYTP_CMD_ABS_WITH_PRESSURE_MODE, .param = mode },
+	};
+	int ret;
+
+	ret = cypress_read_fw_version(psmouse);
+	if (ret)
+		return ret;
+
+	memset(metrics, 0, sizeof(metrics));
+	if (cytp->tp_metrics_supported)
+		cypress_send_ext_cmds(psmouse, cmds, ARRAY_SIZE(cmds));
+	else
+		cypress_send_ext_cmds(psmouse, &cmds[1], 1);
+
+	if (cmds[1].done)
+		cypress_absolute_mode_set(psmouse);
+
+	return cypress_parse_tp_metrics(psmouse, metrics, cmds[0].done);
 }
 
 /*
@@ -419,32 +539,6 @@ static int cypress_set_input_params(struct input_dev *input,
 	return 0;
 }
 
-static int cypress_get_finger_count(unsigned char header_byte)
-{
-	unsigned char bits6_7;
-	int finger_count;
-
-	bits6_7 = header_byte >> 6;
-	finger_count = bits6_7 & 0x03;
-
-	if (finger_count == 1)
-		return 1;
-
-	if (header_byte & ABS_HSCROLL_BIT) {
-		/* HSCROLL gets added on to 0 finger count. */
-		switch (finger_count) {
-			case 0:	return 4;
-			case 2: return 5;
-			default:
-				/* Invalid contact (e.g. palm). Ignore it. */
-				return 0;
-		}
-	}
-
-	return finger_count;
-}
-
-
 static int cypress_parse_packet(struct psmouse *psmouse,
 				struct cytp_data *cytp, struct cytp_report_data *report_data)
 {
@@ -453,7 +547,7 @@ static int cypress_parse_packet(struct psmouse *psmouse,
 
 	memset(report_data, 0, sizeof(struct cytp_report_data));
 
-	report_data->contact_cnt = cypress_get_finger_count(header_byte);
+	report_data->contact_cnt = cytp->frames[header_byte].contacts;
 	report_data->tap = (header_byte & ABS_MULTIFINGER_TAP) ? 1 : 0;
 
 	if (report_data->contact_cnt == 1) {
@@ -560,58 +654,44 @@ static void cypress_process_packet(struct psmouse *psmouse, bool zero_pkt)
 	input_sync(input);
 }
 
-static psmouse_ret_t cypress_validate_byte(struct psmouse *psmouse)
+static psmouse_ret_t cypress_protocol_handler(struct psmouse *psmouse)
 {
-	int contact_cnt;
-	int index = psmouse->pktcnt - 1;
-	unsigned char *packet = psmouse->packet;
 	struct cytp_data *cytp = psmouse->private;
-
-	if (index < 0 || index > cytp->pkt_size)
-		return PSMOUSE_BAD_DATA;
-
-	if (index == 0 && (packet[0] & 0xfc) == 0) {
-		/* call packet process for reporting finger leave. */
-		cypress_process_packet(psmouse, 1);
-		return PSMOUSE_FULL_PACKET;
-	}
-
-	/*
-	 * Perform validation (and adjust packet size) based only on the
-	 * first byte; allow all further bytes through.
-	 */
-	if (index != 0)
-		return PSMOUSE_GOOD_DATA;
+	const struct cytp_frame *frame;
 
 	/*
-	 * If absolute/relative mode bit has not been set yet, just pass
-	 * the byte through.
+	 * Validation and the packet size are decided by the first byte
+	 * alone, through the table built by cypress_build_frames(); all
+	 * further bytes are let through.
 	 */
-	if ((cytp->mode & CYTP_BIT_ABS_REL_MASK) == 0)
-		return PSMOUSE_GOOD_DATA;
+	if (psmouse->pktcnt == 1) {
+		frame = &cytp->frames[psmouse->packet[0]];
 
-	if ((packet[0] & 0x08) == 0x08)
-		return PSMOUSE_BAD_DATA;
+		if (frame->flags & CYTP_FRAME_LEAVE) {
+			/* call packet process for reporting finger leave. */
+			cypress_process_packet(psmouse, 1);
+			return PSMOUSE_FULL_PACKET;
+		}
 
-	contact_cnt = cypress_get_finger_count(packet[0]);
-	if (cytp->mode & CYTP_BIT_ABS_NO_PRESSURE)
-		cypress_set_packet_size(psmouse, contact_cnt == 2 ? 7 : 4);
-	else
-		cypress_set_packet_size(psmouse, contact_cnt == 2 ? 8 : 5);
+		/*
+		 * If absolute/relative mode bit has not been set yet, just
+		 * pass the byte through.
+		 */
+		if ((cytp->mode & CYTP_BIT_ABS_REL_MASK) == 0)
+			return PSMOUSE_GOOD_DATA;
 
-	return PSMOUSE_GOOD_DATA;
-}
+		if (frame->flags & CYTP_FRAME_INVALID)
+			return PSMOUSE_BAD_DATA;
 
-static psmouse_ret_t cypress_protocol_handler(struct psmouse *psmouse)
-{
-	struct cytp_data *cytp = psmouse->private;
+		cytp->pkt_size = frame->len;
+	}
 
 	if (psmouse->pktcnt >= cytp->pkt_size) {
 		cypress_process_packet(psmouse, 0);
 		return PSMOUSE_FULL_PACKET;
 	}
 
-	return cypress_validate_byte(psmouse);
+	return PSMOUSE_GOOD_DATA;
 }
 
 static void cypress_set_rate(struct psmouse *psmouse, unsigned int rate)
@@ -639,30 +719,50 @@ static void cypress_disconnect(struct psmouse *psmouse)
 
 static int cypress_reconnect(struct psmouse *psmouse)
 {
+	unsigned char id[3];
+	unsigned char mode[3];
+	struct cytp_ext_cmd cmds[] = {
+		{ .cmd = CYTP_CMD_READ_CYPRESS_ID, .param = id },
+		{ .cmd = CYTP_CMD_ABS_WITH_PRESSURE_MODE, .param = mode },
+	};
 	int tries = CYTP_PS2_CMD_TRIES;
-	int rc;
+	ktime_t start = ktime_get();
+	bool detected;
 
+	/*
+	 * Detection and the switch back to absolute mode go out as one
+	 * batch; the signature is checked once both have been answered.
+	 */
 	do {
 		cypress_reset(psmouse);
-		rc = cypress_detect(psmouse, false);
-	} while (rc && (--tries > 0));
+		cypress_send_ext_cmds(psmouse, cmds, ARRAY_SIZE(cmds));
 
-	if (rc) {
+		/* Check for Cypress Trackpad signature bytes: 0x33 0xCC */
+		detected = cmds[0].done && id[0] == 0x33 && id[1] == 0xCC;
+	} while (!(detected && cmds[1].done) && --tries > 0);
+
+	if (!detected) {
 		psmouse_err(psmouse, "Reconnect: unable to detect trackpad.\n");
 		return -1;
 	}
 
-	if (cypress_set_absolute_mode(psmouse)) {
+	if (!cmds[1].done) {
 		psmouse_err(psmouse, "Reconnect: Unable to initialize Cypress absolute mode.\n");
 		return -1;
 	}
 
+	cypress_absolute_mode_set(psmouse);
+
+	psmouse_dbg(psmouse, "reconnect took %lld us\n",
+		    ktime_us_delta(ktime_get(), start));
+
 	return 0;
 }
 
 int cypress_init(struct psmouse *psmouse)
 {
 	struct cytp_data *cytp;
+	ktime_t start;
 
 	cytp = kzalloc(sizeof(struct cytp_data), GFP_KERNEL);
 	if (!cytp)
@@ -671,18 +771,26 @@ int cypress_init(struct psmouse *psmouse)
 	psmouse->private = cytp;
 	psmouse->pktsize = 8;
 
+	/* Rebuilt for the real mode once absolute mode is set */
+	cypress_build_frames(cytp);
+
 	cypress_reset(psmouse);
 
+	start = ktime_get();
+
 	if (cypress_query_hardware(psmouse)) {
 		psmouse_err(psmouse, "Unable to query Trackpad hardware.\n");
 		goto err_exit;
 	}
 
-	if (cypress_set_absolute_mode(psmouse)) {
+	if (!(cytp->mode & CYTP_BIT_ABS_PRESSURE)) {
 		psmouse_err(psmouse, "init: Unable to initialize Cypress absolute mode.\n");
 		goto err_exit;
 	}
 
+	psmouse_dbg(psmouse, "hardware query took %lld us\n",
+		    ktime_us_delta(ktime_get(), start));
+
 	if (cypress_set_input_params(psmouse->dev, cytp) < 0) {
 		psmouse_err(psmouse, "init: Unable to set input params.\n");
 		goto err_exit;
@@ -148,6 +148,16 @@ struct cytp_report_data {
 	unsigned int tap:1;  /* multi-finger tap detected. */
 };
 
+/* What the header byte of a packet says about the packet. */
+#define CYTP_FRAME_INVALID 0x01
+#define CYTP_FRAME_LEAVE   0x02  /* all fingers left, no more bytes follow. */
+
+struct cytp_frame {
+	unsigned char len;
+	unsigned char contacts;
+	unsigned char flags;
+};
+
 /* The structure of Cypress Trackpad device private data. */
 struct cytp_data {
 	int fw_version;
@@ -166,6 +176,9 @@ struct cytp_data {
 	int tp_res_y;  /* Y resolution in units/mm. */
 
 	int tp_metrics_supported;
+
+	/* Framing of a packet by its header byte, for the current mode. */
+	struct cytp_frame frames[256];
 };
 
 
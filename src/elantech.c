@@ -16,19 +16,13 @@
 #include <linux/module.h>
 #include <linux/input.h>
 #include <linux/input/mt.h>
+#include <linux/ktime.h>
 #include <linux/serio.h>
 #include <linux/libps2.h>
 #include <asm/unaligned.h>
 #include "psmouse.h"
 #include "elantech.h"
 
-#define elantech_debug(fmt, ...)					\
-	do {								\
-		if (etd->debug)						\
-			psmouse_printk(KERN_DEBUG, psmouse,		\
-					fmt, ##__VA_ARGS__);		\
-	} while (0)
-
 /*
  * Send a Synaptics style sliced query command
  */
@@ -69,7 +63,6 @@ static int elantech_ps2_command(struct psmouse *psmouse,
 				unsigned char *param, int command)
 {
 	struct ps2dev *ps2dev = &psmouse->ps2dev;
-	struct elantech_data *etd = psmouse->private;
 	int rc;
 	int tries = ETP_PS2_COMMAND_TRIES;
 
@@ -78,8 +71,8 @@ static int elantech_ps2_command(struct psmouse *psmouse,
 		if (rc == 0)
 			break;
 		tries--;
-		elantech_debug("retrying ps2 command 0x%02x (%d).\n",
-				command, tries);
+		psmouse_dbg(psmouse, "retrying ps2 command 0x%02x (%d).\n",
+			    command, tries);
 		msleep(ETP_PS2_COMMAND_DELAY);
 	} while (tries > 0);
 
@@ -89,6 +82,37 @@ static int elantech_ps2_command(struct psmouse *psmouse,
 	return rc;
 }
 
+/*
+ * Writable registers, in the order they are restored in. Each has its
+ * value kept in the matching reg_* field of struct elantech_data.
+ */
+static const struct {
+	unsigned char reg;
+	size_t offset;
+} elantech_regs[] = {
+	{ 0x10, offsetof(struct elantech_data, reg_10) },
+	{ 0x11, offsetof(struct elantech_data, reg_11) },
+	{ 0x20, offsetof(struct elantech_data, reg_20) },
+	{ 0x21, offsetof(struct elantech_data, reg_21) },
+	{ 0x22, offsetof(struct elantech_data, reg_22) },
+	{ 0x23, offsetof(struct elantech_data, reg_23) },
+	{ 0x24, offsetof(struct elantech_data, reg_24) },
+	{ 0x25, offsetof(struct elantech_data, reg_25) },
+	{ 0x26, offsetof(struct elantech_data, reg_26) },
+	{ 0x07, offsetof(struct elantech_data, reg_07) },
+};
+
+static unsigned int elantech_reg_bit(unsigned char reg)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(elantech_regs); i++)
+		if (elantech_regs[i].reg == reg)
+			return 1 << i;
+
+	return 0;
+}
+
 /*
  * Send an Elantech style special command to read a value from a register
  */
@@ -213,23 +237,12 @@ static int elantech_write_reg(struct psmouse *psmouse, unsigned char reg,
 		psmouse_err(psmouse,
 			    "failed to write register 0x%02x with value 0x%02x.\n",
 			    reg, val);
+	else
+		etd->regs_synced |= elantech_reg_bit(reg);
 
 	return rc;
 }
 
-/*
- * Dump a complete mouse movement packet to the syslog
- */
-static void elantech_packet_dump(struct psmouse *psmouse)
-{
-	int	i;
-
-	psmouse_printk(KERN_DEBUG, psmouse, "PS/2 packet [");
-	for (i = 0; i < psmouse->pktsize; i++)
-		printk("%s0x%02x ", i ? ", " : " ", psmouse->packet[i]);
-	printk("]\n");
-}
-
 /*
  * Interpret complete data packets and report absolute mode input events for
  * hardware version 1. (4 byte packets)
@@ -262,7 +275,8 @@ static void elantech_report_absolute_v1(struct psmouse *psmouse)
 		} else if (etd->single_finger_reports < 2) {
 			/* Discard first 2 reports of one finger, bogus */
 			etd->single_finger_reports++;
-			elantech_debug("discarding packet\n");
+			psmouse_diag(psmouse, PSMOUSE_DIAG_DISCARDED,
+				     "discarding packet\n");
 			return;
 		}
 	}
@@ -450,9 +464,9 @@ static void elantech_report_trackpoint(struct psmouse *psmouse,
 		break;
 
 	default:
-		/* Dump unexpected packet sequences if debug=1 (default) */
-		if (etd->debug == 1)
-			elantech_packet_dump(psmouse);
+		psmouse_diag(psmouse, PSMOUSE_DIAG_UNEXPECTED,
+			     "unexpected packet %*ph\n",
+			     psmouse->pktsize, psmouse->packet);
 
 		break;
 	}
@@ -547,24 +561,27 @@ static void elantech_input_sync_v4(struct psmouse *psmouse)
 {
 	struct input_dev *dev = psmouse->dev;
 	struct elantech_data *etd = psmouse->private;
-	unsigned char *packet = psmouse->packet;
+	unsigned char buttons = etd->frame_buttons;
 
 	/* For clickpads map both buttons to BTN_LEFT */
 	if (etd->fw_version & 0x001000) {
-		input_report_key(dev, BTN_LEFT, packet[0] & 0x03);
+		input_report_key(dev, BTN_LEFT, buttons & 0x03);
 	} else {
-		input_report_key(dev, BTN_LEFT, packet[0] & 0x01);
-		input_report_key(dev, BTN_RIGHT, packet[0] & 0x02);
-		input_report_key(dev, BTN_MIDDLE, packet[0] & 0x04);
+		input_report_key(dev, BTN_LEFT, buttons & 0x01);
+		input_report_key(dev, BTN_RIGHT, buttons & 0x02);
+		input_report_key(dev, BTN_MIDDLE, buttons & 0x04);
 	}
 
 	input_mt_report_pointer_emulation(dev, true);
 	input_sync(dev);
+
+	etd->frame_slots = 0;
 }
 
 static void process_packet_status_v4(struct psmouse *psmouse)
 {
 	struct input_dev *dev = psmouse->dev;
+	struct elantech_data *etd = psmouse->private;
 	unsigned char *packet = psmouse->packet;
 	unsigned fingers;
 	int i;
@@ -578,7 +595,7 @@ static void process_packet_status_v4(struct psmouse *psmouse)
 		}
 	}
 
-	elantech_input_sync_v4(psmouse);
+	etd->frame_fingers = fingers;
 }
 
 static void process_packet_head_v4(struct psmouse *psmouse)
@@ -606,8 +623,6 @@ static void process_packet_head_v4(struct psmouse *psmouse)
 	input_report_abs(dev, ABS_MT_TOUCH_MAJOR, traces * etd->width);
 	/* report this for backwards compatibility */
 	input_report_abs(dev, ABS_TOOL_WIDTH, traces);
-
-	elantech_input_sync_v4(psmouse);
 }
 
 static void process_packet_motion_v4(struct psmouse *psmouse)
@@ -647,13 +662,78 @@ static void process_packet_motion_v4(struct psmouse *psmouse)
 		input_report_abs(dev, ABS_MT_POSITION_X, etd->mt[sid].x);
 		input_report_abs(dev, ABS_MT_POSITION_Y, etd->mt[sid].y);
 	}
+}
+
+/*
+ * Slots a head or motion packet is going to update.
+ */
+static unsigned int elantech_packet_slots_v4(const unsigned char *packet,
+					     int packet_type)
+{
+	int id, sid;
+
+	switch (packet_type) {
+	case PACKET_V4_HEAD:
+		id = ((packet[3] & 0xe0) >> 5) - 1;
+		return id < 0 ? 0 : 1 << id;
+
+	case PACKET_V4_MOTION:
+		id = ((packet[0] & 0xe0) >> 5) - 1;
+		if (id < 0)
+			return 0;
+
+		sid = ((packet[3] & 0xe0) >> 5) - 1;
+		return (1 << id) | (sid < 0 ? 0 : 1 << sid);
+	}
+
+	return 0;
+}
+
+/*
+ * Head and motion packets only carry one or two fingers each, so with
+ * several fingers down one scan of the sensor arrives as a burst of
+ * packets. Rather than syncing after each of them we collect the burst
+ * into a single frame, which is sent once every finger announced by the
+ * last status packet has been updated, when a finger shows up again
+ * (meaning the next scan has started), when the buttons change, on a
+ * status packet, or at the latest 'frame_timeout' milliseconds after
+ * the first packet of the frame. The timer is only armed when a frame
+ * starts. Setting 'frame_timeout' to 0 syncs after every packet.
+ */
+static void elantech_flush_frame_v4(unsigned long data)
+{
+	struct psmouse *psmouse = (struct psmouse *)data;
+	struct elantech_data *etd = psmouse->private;
+
+	serio_pause_rx(psmouse->ps2dev.serio);
+
+	if (etd->frame_slots)
+		elantech_input_sync_v4(psmouse);
 
-	elantech_input_sync_v4(psmouse);
+	serio_continue_rx(psmouse->ps2dev.serio);
 }
 
 static void elantech_report_absolute_v4(struct psmouse *psmouse,
 					int packet_type)
 {
+	struct elantech_data *etd = psmouse->private;
+	unsigned char buttons = psmouse->packet[0] & 0x07;
+	unsigned int slots;
+
+	slots = elantech_packet_slots_v4(psmouse->packet, packet_type);
+	if (!slots && packet_type != PACKET_V4_STATUS)
+		return;
+
+	if (etd->frame_slots) {
+		if ((etd->frame_slots & slots) ||
+		    buttons != etd->frame_buttons)
+			elantech_input_sync_v4(psmouse);
+		else if (packet_type != PACKET_V4_STATUS)
+			etd->merged_packets++;
+	}
+
+	etd->frame_buttons = buttons;
+
 	switch (packet_type) {
 	case PACKET_V4_STATUS:
 		process_packet_status_v4(psmouse);
@@ -672,6 +752,18 @@ static void elantech_report_absolute_v4(struct psmouse *psmouse,
 		/* impossible to get here */
 		break;
 	}
+
+	slots |= etd->frame_slots;
+	if (packet_type == PACKET_V4_STATUS || !etd->frame_timeout ||
+	    (slots & etd->frame_fingers) == etd->frame_fingers) {
+		del_timer(&etd->frame_timer);
+		elantech_input_sync_v4(psmouse);
+	} else {
+		if (!etd->frame_slots)
+			mod_timer(&etd->frame_timer,
+				  jiffies + msecs_to_jiffies(etd->frame_timeout));
+		etd->frame_slots = slots;
+	}
 }
 
 static int elantech_packet_check_v1(struct psmouse *psmouse)
@@ -740,163 +832,293 @@ static int elantech_packet_check_v2(struct psmouse *psmouse)
 
 /*
  * We check the constant bits to determine what packet type we get,
- * so packet checking is mandatory for v3 and later hardware.
+ * so packet checking is mandatory for v3 and later hardware. The
+ * signatures depend on the hardware version and the 'crc_enabled'
+ * flag, so they are put together in etd->sigs once, by
+ * elantech_setup_packet_handler(), and each packet is then matched
+ * against that table with a masked compare of its first 4 bytes.
  */
-static int elantech_packet_check_v3(struct psmouse *psmouse)
+static const struct elantech_packet_sig elantech_sigs_v3[] = {
+	{ 0xcf00000c, 0x02000004, PACKET_V3_HEAD },
+	{ 0xce00000c, 0x0c00000c, PACKET_V3_TAIL },
+	{ 0x0f000000, 0x06000000, PACKET_TRACKPOINT },
+	{ }
+};
+
+static const struct elantech_packet_sig elantech_sigs_v3_crc[] = {
+	{ 0x09000000, 0x08000000, PACKET_V3_HEAD },
+	{ 0x09000000, 0x09000000, PACKET_V3_TAIL },
+	{ }
+};
+
+static int elantech_packet_type(struct psmouse *psmouse)
 {
 	struct elantech_data *etd = psmouse->private;
-	const u8 debounce_packet[] = { 0xc4, 0xff, 0xff, 0x02, 0xff, 0xff };
-	unsigned char *packet = psmouse->packet;
+	const struct elantech_packet_sig *sig;
+	u32 t = get_unaligned_le32(psmouse->packet);
 
-	/*
-	 * check debounce first, it has the same signature in byte 0
-	 * and byte 3 as PACKET_V3_HEAD.
-	 */
-	if (!memcmp(packet, debounce_packet, sizeof(debounce_packet)))
-		return PACKET_DEBOUNCE;
+	for (sig = etd->sigs; sig->type; sig++)
+		if ((t & sig->mask) == sig->value)
+			return sig->type;
 
-	/*
-	 * If the hardware flag 'crc_enabled' is set the packets have
-	 * different signatures.
-	 */
-	if (etd->crc_enabled) {
-		if ((packet[3] & 0x09) == 0x08)
-			return PACKET_V3_HEAD;
+	return PACKET_UNKNOWN;
+}
+
+/*
+ * Build the v4 signature table. The constant bits change depending on
+ * the value of the hardware flag 'crc_enabled' and the version of the
+ * IC body, but are the same for every packet, regardless of the type,
+ * which is given by the low bits of byte 3.
+ */
+static void elantech_setup_sigs_v4(struct elantech_data *etd)
+{
+	/* This represents the version of IC body. */
+	unsigned int ic_version = (etd->fw_version & 0x0f0000) >> 16;
+	static const int types[] = {
+		PACKET_V4_STATUS, PACKET_V4_HEAD, PACKET_V4_MOTION
+	};
+	u32 mask, value;
+	int i, n = 0;
 
-		if ((packet[3] & 0x09) == 0x09)
-			return PACKET_V3_TAIL;
+	if (etd->crc_enabled) {
+		mask = 0x08000000;
+		value = 0x00000000;
+	} else if (ic_version == 7 && etd->samples[1] == 0x2A) {
+		mask = 0x1c000000;
+		value = 0x10000000;
 	} else {
-		if ((packet[0] & 0x0c) == 0x04 && (packet[3] & 0xcf) == 0x02)
-			return PACKET_V3_HEAD;
+		mask = 0x1c00000c;
+		value = 0x10000004;
+	}
 
-		if ((packet[0] & 0x0c) == 0x0c && (packet[3] & 0xce) == 0x0c)
-			return PACKET_V3_TAIL;
-		if ((packet[3] & 0x0f) == 0x06)
-			return PACKET_TRACKPOINT;
+	if (etd->tp_dev) {
+		etd->sigs[n].mask = 0x0f000000;
+		etd->sigs[n].value = 0x06000000;
+		etd->sigs[n].type = PACKET_TRACKPOINT;
+		n++;
 	}
 
-	return PACKET_UNKNOWN;
+	for (i = 0; i < ARRAY_SIZE(types); i++) {
+		etd->sigs[n].mask = mask | 0x03000000;
+		etd->sigs[n].value = value | (i << 24);
+		etd->sigs[n].type = types[i];
+		n++;
+	}
+
+	etd->sigs[n].type = 0;
 }
 
-static int elantech_packet_check_v4(struct psmouse *psmouse)
+/*
+ * Process byte stream from mouse and handle complete packets. There is
+ * one handler per hardware version and packet checking mode, chosen by
+ * elantech_setup_packet_handler(), so that none of this needs to be
+ * decided again for every packet.
+ */
+static psmouse_ret_t elantech_process_byte_v1(struct psmouse *psmouse)
 {
-	struct elantech_data *etd = psmouse->private;
-	unsigned char *packet = psmouse->packet;
-	unsigned char packet_type = packet[3] & 0x03;
-	unsigned int ic_version;
-	bool sanity_check;
+	if (psmouse->pktcnt < psmouse->pktsize)
+		return PSMOUSE_GOOD_DATA;
 
-	if (etd->tp_dev && (packet[3] & 0x0f) == 0x06)
-		return PACKET_TRACKPOINT;
+	if (!elantech_packet_check_v1(psmouse))
+		return PSMOUSE_BAD_DATA;
 
-	/* This represents the version of IC body. */
-	ic_version = (etd->fw_version & 0x0f0000) >> 16;
+	elantech_report_absolute_v1(psmouse);
+
+	return PSMOUSE_FULL_PACKET;
+}
+
+static psmouse_ret_t elantech_process_byte_v1_nocheck(struct psmouse *psmouse)
+{
+	if (psmouse->pktcnt < psmouse->pktsize)
+		return PSMOUSE_GOOD_DATA;
+
+	elantech_report_absolute_v1(psmouse);
+
+	return PSMOUSE_FULL_PACKET;
+}
+
+static psmouse_ret_t elantech_process_byte_v2(struct psmouse *psmouse)
+{
+	if (psmouse->pktcnt < psmouse->pktsize)
+		return PSMOUSE_GOOD_DATA;
+
+	/* ignore debounce */
+	if (elantech_debounce_check_v2(psmouse))
+		return PSMOUSE_FULL_PACKET;
+
+	if (!elantech_packet_check_v2(psmouse))
+		return PSMOUSE_BAD_DATA;
+
+	elantech_report_absolute_v2(psmouse);
+
+	return PSMOUSE_FULL_PACKET;
+}
+
+static psmouse_ret_t elantech_process_byte_v2_nocheck(struct psmouse *psmouse)
+{
+	if (psmouse->pktcnt < psmouse->pktsize)
+		return PSMOUSE_GOOD_DATA;
+
+	/* ignore debounce */
+	if (elantech_debounce_check_v2(psmouse))
+		return PSMOUSE_FULL_PACKET;
+
+	elantech_report_absolute_v2(psmouse);
+
+	return PSMOUSE_FULL_PACKET;
+}
+
+static psmouse_ret_t elantech_process_byte_v3(struct psmouse *psmouse)
+{
+	static const u8 debounce_packet[] = {
+		0xc4, 0xff, 0xff, 0x02, 0xff, 0xff
+	};
+	int packet_type;
+
+	if (psmouse->pktcnt < psmouse->pktsize)
+		return PSMOUSE_GOOD_DATA;
 
 	/*
-	 * Sanity check based on the constant bits of a packet.
-	 * The constant bits change depending on the value of
-	 * the hardware flag 'crc_enabled' and the version of
-	 * the IC body, but are the same for every packet,
-	 * regardless of the type.
+	 * check debounce first, it has the same signature in byte 0
+	 * and byte 3 as PACKET_V3_HEAD.
 	 */
-	if (etd->crc_enabled)
-		sanity_check = ((packet[3] & 0x08) == 0x00);
-	else if (ic_version == 7 && etd->samples[1] == 0x2A)
-		sanity_check = ((packet[3] & 0x1c) == 0x10);
-	else
-		sanity_check = ((packet[0] & 0x0c) == 0x04 &&
-				(packet[3] & 0x1c) == 0x10);
-
-	if (!sanity_check)
-		return PACKET_UNKNOWN;
+	if (!memcmp(psmouse->packet, debounce_packet, sizeof(debounce_packet)))
+		return PSMOUSE_FULL_PACKET;
 
+	packet_type = elantech_packet_type(psmouse);
 	switch (packet_type) {
-	case 0:
-		return PACKET_V4_STATUS;
+	case PACKET_UNKNOWN:
+		return PSMOUSE_BAD_DATA;
 
-	case 1:
-		return PACKET_V4_HEAD;
+	case PACKET_TRACKPOINT:
+		elantech_report_trackpoint(psmouse, packet_type);
+		break;
 
-	case 2:
-		return PACKET_V4_MOTION;
+	default:
+		elantech_report_absolute_v3(psmouse, packet_type);
+		break;
 	}
 
-	return PACKET_UNKNOWN;
+	return PSMOUSE_FULL_PACKET;
 }
 
-/*
- * Process byte stream from mouse and handle complete packets
- */
-static psmouse_ret_t elantech_process_byte(struct psmouse *psmouse)
+static psmouse_ret_t elantech_process_byte_v4(struct psmouse *psmouse)
 {
-	struct elantech_data *etd = psmouse->private;
 	int packet_type;
 
 	if (psmouse->pktcnt < psmouse->pktsize)
 		return PSMOUSE_GOOD_DATA;
 
-	if (etd->debug > 1)
-		elantech_packet_dump(psmouse);
+	packet_type = elantech_packet_type(psmouse);
+	switch (packet_type) {
+	case PACKET_UNKNOWN:
+		return PSMOUSE_BAD_DATA;
 
-	switch (etd->hw_version) {
-	case 1:
-		if (etd->paritycheck && !elantech_packet_check_v1(psmouse))
-			return PSMOUSE_BAD_DATA;
+	case PACKET_TRACKPOINT:
+		elantech_report_trackpoint(psmouse, packet_type);
+		break;
 
-		elantech_report_absolute_v1(psmouse);
+	default:
+		elantech_report_absolute_v4(psmouse, packet_type);
 		break;
+	}
 
-	case 2:
-		/* ignore debounce */
-		if (elantech_debounce_check_v2(psmouse))
-			return PSMOUSE_FULL_PACKET;
+	return PSMOUSE_FULL_PACKET;
+}
+
+/*
+ * Pick the packet handler matching the hardware version and the current
+ * packet checking settings. Needs to be called again whenever
+ * paritycheck or crc_enabled change.
+ */
+static void elantech_setup_packet_handler(struct psmouse *psmouse)
+{
+	struct elantech_data *etd = psmouse->private;
 
-		if (etd->paritycheck && !elantech_packet_check_v2(psmouse))
-			return PSMOUSE_BAD_DATA;
+	switch (etd->hw_version) {
+	case 1:
+		psmouse->protocol_handler = etd->paritycheck ?
+			elantech_process_byte_v1 :
+			elantech_process_byte_v1_nocheck;
+		break;
 
-		elantech_report_absolute_v2(psmouse);
+	case 2:
+		psmouse->protocol_handler = etd->paritycheck ?
+			elantech_process_byte_v2 :
+			elantech_process_byte_v2_nocheck;
 		break;
 
 	case 3:
-		packet_type = elantech_packet_check_v3(psmouse);
-		switch (packet_type) {
-		case PACKET_UNKNOWN:
-			return PSMOUSE_BAD_DATA;
+		memcpy(etd->sigs,
+		       etd->crc_enabled ? elantech_sigs_v3_crc : elantech_sigs_v3,
+		       etd->crc_enabled ? sizeof(elantech_sigs_v3_crc) :
+					  sizeof(elantech_sigs_v3));
+		psmouse->protocol_handler = elantech_process_byte_v3;
+		break;
 
-		case PACKET_DEBOUNCE:
-			/* ignore debounce */
-			break;
+	case 4:
+		elantech_setup_sigs_v4(etd);
+		psmouse->protocol_handler = elantech_process_byte_v4;
+		break;
+	}
+}
 
-		case PACKET_TRACKPOINT:
-			elantech_report_trackpoint(psmouse, packet_type);
-			break;
+/*
+ * Write back every saved register the hardware is not known to hold,
+ * in one batch, optionally verified by a single read-back of reg 0x10
+ * at the end as elantech_set_absolute_mode() used to do. Returns the
+ * number of registers written or -1 on error.
+ */
+static int elantech_restore_regs(struct psmouse *psmouse, bool verify)
+{
+	struct elantech_data *etd = psmouse->private;
+	unsigned char reg, val;
+	int i, rc, count = 0;
+	int tries = ETP_READ_BACK_TRIES;
 
-		default:
-			elantech_report_absolute_v3(psmouse, packet_type);
-			break;
-		}
+	for (i = 0; i < ARRAY_SIZE(elantech_regs); i++) {
+		if (!(etd->regs_saved & ~etd->regs_synced & (1 << i)))
+			continue;
 
-		break;
+		reg = elantech_regs[i].reg;
+		val = *((unsigned char *)etd + elantech_regs[i].offset);
+		if (elantech_write_reg(psmouse, reg, val))
+			return -1;
 
-	case 4:
-		packet_type = elantech_packet_check_v4(psmouse);
-		switch (packet_type) {
-		case PACKET_UNKNOWN:
-			return PSMOUSE_BAD_DATA;
+		count++;
+	}
 
-		case PACKET_TRACKPOINT:
-			elantech_report_trackpoint(psmouse, packet_type);
-			break;
+	/* v4 has no reg 0x10 to read */
+	if (!verify || !count || etd->hw_version == 4)
+		return count;
 
-		default:
-			elantech_report_absolute_v4(psmouse, packet_type);
+	/*
+	 * Read back reg 0x10 once the whole batch is written. For hardware
+	 * version 1 we must make sure the absolute mode bit is set. For
+	 * hardware version 2 the touchpad is probably initializing and not
+	 * ready until we read back the value we just wrote.
+	 */
+	do {
+		rc = elantech_read_reg(psmouse, 0x10, &val);
+		if (rc == 0)
 			break;
-		}
+		tries--;
+		psmouse_dbg(psmouse, "retrying read (%d).\n", tries);
+		msleep(ETP_READ_BACK_DELAY);
+	} while (tries > 0);
 
-		break;
+	if (rc) {
+		psmouse_err(psmouse, "failed to read back register 0x10.\n");
+		return -1;
 	}
 
-	return PSMOUSE_FULL_PACKET;
+	if (etd->hw_version == 1 && !(val & ETP_R10_ABSOLUTE_MODE)) {
+		psmouse_err(psmouse,
+			    "touchpad refuses to switch to absolute mode.\n");
+		return -1;
+	}
+
+	return count;
 }
 
 /*
@@ -908,10 +1130,16 @@ static void elantech_set_rate_restore_reg_07(struct psmouse *psmouse,
 		unsigned int rate)
 {
 	struct elantech_data *etd = psmouse->private;
+	ktime_t start = ktime_get();
 
 	etd->original_set_rate(psmouse, rate);
-	if (elantech_write_reg(psmouse, 0x07, etd->reg_07))
+
+	etd->regs_synced &= ~elantech_reg_bit(0x07);
+	if (elantech_restore_regs(psmouse, false) < 0)
 		psmouse_err(psmouse, "restoring reg_07 failed\n");
+
+	psmouse_dbg(psmouse, "rate change to %u took %lld us\n",
+		    rate, ktime_us_delta(ktime_get(), start));
 }
 
 /*
@@ -977,7 +1205,7 @@ static int elantech_set_absolute_mode(struct psmouse *psmouse)
 			if (rc == 0)
 				break;
 			tries--;
-			elantech_debug("retrying read (%d).\n", tries);
+			psmouse_dbg(psmouse, "retrying read (%d).\n", tries);
 			msleep(ETP_READ_BACK_DELAY);
 		} while (tries > 0);
 
@@ -1324,8 +1552,24 @@ static ssize_t elantech_set_int_attr(struct psmouse *psmouse,
 			value |= ETP_R11_4_BYTE_MODE;
 	}
 
-	if (!attr->reg || elantech_write_reg(psmouse, attr->reg, value) == 0)
-		*reg = value;
+	if (attr->reg) {
+		unsigned int bit = elantech_reg_bit(attr->reg);
+
+		/* nothing to do if the hardware already holds this value */
+		if ((etd->regs_synced & bit) && *reg == value)
+			return count;
+
+		if (elantech_write_reg(psmouse, attr->reg, value))
+			return count;
+
+		etd->regs_saved |= bit;
+	}
+
+	*reg = value;
+
+	/* paritycheck and crc_enabled decide the packet handler */
+	if (!attr->reg)
+		elantech_setup_packet_handler(psmouse);
 
 	return count;
 }
@@ -1350,10 +1594,91 @@ ELANTECH_INT_ATTR(reg_23, 0x23);
 ELANTECH_INT_ATTR(reg_24, 0x24);
 ELANTECH_INT_ATTR(reg_25, 0x25);
 ELANTECH_INT_ATTR(reg_26, 0x26);
-ELANTECH_INT_ATTR(debug, 0);
 ELANTECH_INT_ATTR(paritycheck, 0);
 ELANTECH_INT_ATTR(crc_enabled, 0);
 
+/*
+ * Old per-driver debug knob, now mapped onto the psmouse diagnostic
+ * level: 1 logs unexpected packets, 2 also dumps every packet.
+ */
+static ssize_t elantech_show_debug(struct psmouse *psmouse,
+				   void *data, char *buf)
+{
+	return sprintf(buf, "%u\n",
+		       psmouse->diag >= PSMOUSE_DIAG_TRACE ? 2 :
+		       psmouse->diag >= PSMOUSE_DIAG_LOG ? 1 : 0);
+}
+
+static ssize_t elantech_set_debug(struct psmouse *psmouse, void *data,
+				  const char *buf, size_t count)
+{
+	static const unsigned int levels[] = {
+		PSMOUSE_DIAG_OFF, PSMOUSE_DIAG_LOG, PSMOUSE_DIAG_TRACE,
+	};
+	unsigned int value;
+	int err;
+
+	err = kstrtouint(buf, 16, &value);
+	if (err)
+		return err;
+
+	if (value >= ARRAY_SIZE(levels))
+		return -EINVAL;
+
+	psmouse_set_diag(psmouse, levels[value]);
+
+	return count;
+}
+
+__PSMOUSE_DEFINE_ATTR(debug, S_IWUSR | S_IRUGO, NULL,
+		      elantech_show_debug, elantech_set_debug, false);
+
+static ssize_t elantech_show_merged_packets(struct psmouse *psmouse,
+					    void *data, char *buf)
+{
+	struct elantech_data *etd = psmouse->private;
+
+	return sprintf(buf, "%lu\n", etd->merged_packets);
+}
+
+PSMOUSE_DEFINE_RO_ATTR(merged_packets, S_IRUGO, NULL,
+		       elantech_show_merged_packets);
+
+/*
+ * Unlike the register attributes, the frame timeout is a plain number
+ * of milliseconds.
+ */
+static ssize_t elantech_show_frame_timeout(struct psmouse *psmouse,
+					   void *data, char *buf)
+{
+	struct elantech_data *etd = psmouse->private;
+
+	return sprintf(buf, "%u\n", etd->frame_timeout);
+}
+
+static ssize_t elantech_set_frame_timeout(struct psmouse *psmouse,
+					  void *data, const char *buf,
+					  size_t count)
+{
+	struct elantech_data *etd = psmouse->private;
+	unsigned int value;
+	int err;
+
+	err = kstrtouint(buf, 10, &value);
+	if (err)
+		return err;
+
+	if (value > ETP_FRAME_TIMEOUT_MAX)
+		return -EINVAL;
+
+	etd->frame_timeout = value;
+
+	return count;
+}
+
+PSMOUSE_DEFINE_ATTR(frame_timeout, S_IWUSR | S_IRUGO, NULL,
+		    elantech_show_frame_timeout, elantech_set_frame_timeout);
+
 static struct attribute *elantech_attrs[] = {
 	&psmouse_attr_reg_07.dattr.attr,
 	&psmouse_attr_reg_10.dattr.attr,
@@ -1368,6 +1693,8 @@ static struct attribute *elantech_attrs[] = {
 	&psmouse_attr_debug.dattr.attr,
 	&psmouse_attr_paritycheck.dattr.attr,
 	&psmouse_attr_crc_enabled.dattr.attr,
+	&psmouse_attr_frame_timeout.dattr.attr,
+	&psmouse_attr_merged_packets.dattr.attr,
 	NULL
 };
 
@@ -1467,6 +1794,7 @@ static void elantech_disconnect(struct psmouse *psmouse)
 {
 	struct elantech_data *etd = psmouse->private;
 
+	del_timer_sync(&etd->frame_timer);
 	if (etd->tp_dev)
 		input_unregister_device(etd->tp_dev);
 	sysfs_remove_group(&psmouse->ps2dev.serio->dev.kobj,
@@ -1480,17 +1808,31 @@ static void elantech_disconnect(struct psmouse *psmouse)
  */
 static int elantech_reconnect(struct psmouse *psmouse)
 {
+	struct elantech_data *etd = psmouse->private;
+	ktime_t start = ktime_get();
+	int count;
+
 	psmouse_reset(psmouse);
+	etd->regs_synced = 0;
 
 	if (elantech_detect(psmouse, 0))
 		return -1;
 
-	if (elantech_set_absolute_mode(psmouse)) {
+	/*
+	 * Bring back everything we had written before, not only what
+	 * elantech_set_absolute_mode() sets up, so that changes made
+	 * through sysfs survive as well.
+	 */
+	count = elantech_restore_regs(psmouse, true);
+	if (count < 0) {
 		psmouse_err(psmouse,
 			    "failed to put touchpad back into absolute mode.\n");
 		return -1;
 	}
 
+	psmouse_dbg(psmouse, "reconnect took %lld us, %d registers restored\n",
+		    ktime_us_delta(ktime_get(), start), count);
+
 	return 0;
 }
 
@@ -1590,13 +1932,8 @@ static int elantech_set_properties(struct elantech_data *etd)
 	etd->jumpy_cursor =
 		(etd->fw_version == 0x020022 || etd->fw_version == 0x020600);
 
-	if (etd->hw_version > 1) {
-		/* For now show extra debug information */
-		etd->debug = 1;
-
-		if (etd->fw_version >= 0x020800)
-			etd->reports_pressure = true;
-	}
+	if (etd->hw_version > 1 && etd->fw_version >= 0x020800)
+		etd->reports_pressure = true;
 
 	/*
 	 * The signatures of v3 and v4 packets change depending on the
@@ -1626,6 +1963,10 @@ int elantech_init(struct psmouse *psmouse)
 	if (!etd)
 		return -ENOMEM;
 
+	setup_timer(&etd->frame_timer, elantech_flush_frame_v4,
+		    (unsigned long)psmouse);
+	etd->frame_timeout = ETP_FRAME_TIMEOUT_V4;
+
 	psmouse_reset(psmouse);
 
 	etd->parity[0] = 1;
@@ -1728,7 +2069,10 @@ int elantech_init(struct psmouse *psmouse)
 			goto init_fail_tp_reg;
 	}
 
-	psmouse->protocol_handler = elantech_process_byte;
+	/* whatever we have written so far is what reconnect restores */
+	etd->regs_saved = etd->regs_synced;
+
+	elantech_setup_packet_handler(psmouse);
 	psmouse->disconnect = elantech_disconnect;
 	psmouse->reconnect = elantech_reconnect;
 	psmouse->pktsize = etd->hw_version > 1 ? 6 : 4;
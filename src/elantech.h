@@ -106,6 +106,12 @@
  */
 #define ETP_WEIGHT_VALUE		5
 
+/*
+ * how long to wait for the rest of a v4 frame before syncing, in ms
+ */
+#define ETP_FRAME_TIMEOUT_V4		10
+#define ETP_FRAME_TIMEOUT_MAX		1000
+
 /*
  * The base position for one finger, v4 hardware
  */
@@ -114,6 +120,16 @@ struct finger_pos {
 	unsigned int y;
 };
 
+/*
+ * Constant bits identifying a packet type: the first 4 bytes of the
+ * packet, read little endian and masked with mask, must equal value.
+ */
+struct elantech_packet_sig {
+	u32 mask;
+	u32 value;
+	int type;
+};
+
 struct elantech_data {
 	struct input_dev *tp_dev;	/* Relative device for trackpoint */
 	char tp_phys[32];
@@ -127,7 +143,8 @@ struct elantech_data {
 	unsigned char reg_24;
 	unsigned char reg_25;
 	unsigned char reg_26;
-	unsigned char debug;
+	unsigned int regs_saved;	/* registers reconnect writes back */
+	unsigned int regs_synced;	/* registers the hardware holds */
 	unsigned char capabilities[3];
 	unsigned char samples[3];
 	bool paritycheck;
@@ -141,7 +158,14 @@ struct elantech_data {
 	unsigned int y_max;
 	unsigned int width;
 	struct finger_pos mt[ETP_MAX_FINGERS];
+	struct timer_list frame_timer;	/* flushes a partial v4 frame */
+	unsigned int frame_timeout;	/* ms */
+	unsigned char frame_buttons;
+	unsigned int frame_fingers;	/* fingers down, as of last status */
+	unsigned int frame_slots;	/* slots updated since last sync */
+	unsigned long merged_packets;
 	unsigned char parity[256];
+	struct elantech_packet_sig sigs[5];	/* v3/v4 packet signatures */
 	int (*send_cmd)(struct psmouse *psmouse, unsigned char c, unsigned char *param);
 	void (*original_set_rate)(struct psmouse *psmouse, unsigned int rate);
 };
@@ -67,6 +67,13 @@ static void focaltech_reset(struct psmouse *psmouse)
 
 #define FOC_MAX_FINGERS 5
 
+/*
+ * Largest error, in touchpad units, between the position integrated from
+ * relative packets and the next absolute packet that we still consider
+ * to be noise rather than drift.
+ */
+#define FOC_DRIFT_THRESHOLD 32
+
 /*
  * Current state of a single finger on the touchpad.
  */
@@ -90,6 +97,9 @@ struct focaltech_finger_state {
 	 */
 	unsigned int x;
 	unsigned int y;
+
+	/* When the last absolute packet for the finger arrived (jiffies). */
+	unsigned long anchor_time;
 };
 
 /*
@@ -115,11 +125,27 @@ struct focaltech_hw_state {
 
 	/* True if the clickpad has been pressed. */
 	bool pressed;
+
+	/*
+	 * Bitmap of fingers whose state changed since the last report;
+	 * only those slots need to be sent to the input core again.
+	 */
+	unsigned int dirty;
 };
 
 struct focaltech_data {
 	unsigned int x_max, y_max;
 	struct focaltech_hw_state state;
+
+	/*
+	 * Relative packets are integrated onto the last absolute position
+	 * of a finger. These count how often that went wrong: the next
+	 * absolute packet was off by more than FOC_DRIFT_THRESHOLD, or the
+	 * integrated position left the touchpad and had to be clamped.
+	 */
+	unsigned long drift_corrections;
+	unsigned long clamp_corrections;
+	unsigned int max_anchor_age;	/* in ms */
 };
 
 static void focaltech_report_state(struct psmouse *psmouse)
@@ -127,12 +153,17 @@ static void focaltech_report_state(struct psmouse *psmouse)
 	struct focaltech_data *priv = psmouse->private;
 	struct focaltech_hw_state *state = &priv->state;
 	struct input_dev *dev = psmouse->dev;
+	bool touching = false;
 	int i;
 
 	for (i = 0; i < FOC_MAX_FINGERS; i++) {
 		struct focaltech_finger_state *finger = &state->fingers[i];
 		bool active = finger->active && finger->valid;
 
+		touching |= active;
+		if (!(state->dirty & BIT(i)))
+			continue;
+
 		input_mt_slot(dev, i);
 		input_mt_report_slot_state(dev, MT_TOOL_FINGER, active);
 		if (active) {
@@ -147,9 +178,18 @@ static void focaltech_report_state(struct psmouse *psmouse)
 			input_report_abs(dev, ABS_MT_POSITION_X, clamped_x);
 			input_report_abs(dev, ABS_MT_POSITION_Y,
 					 priv->y_max - clamped_y);
-			input_report_abs(dev, ABS_TOOL_WIDTH, state->width);
 		}
 	}
+	state->dirty = 0;
+
+	/*
+	 * The width is not per slot, and may come with an absolute packet
+	 * for a finger that is not touching, so it is reported as long as
+	 * any finger is, not only along with the changed slots.
+	 */
+	if (touching)
+		input_report_abs(dev, ABS_TOOL_WIDTH, state->width);
+
 	input_mt_report_pointer_emulation(dev, true);
 
 	input_report_key(psmouse->dev, BTN_LEFT, state->pressed);
@@ -168,13 +208,21 @@ static void focaltech_process_touch_packet(struct psmouse *psmouse,
 
 	/* the second byte contains a bitmap of all fingers touching the pad */
 	for (i = 0; i < FOC_MAX_FINGERS; i++) {
-		state->fingers[i].active = fingers & 0x1;
-		if (!state->fingers[i].active) {
+		struct focaltech_finger_state *finger = &state->fingers[i];
+		bool active = fingers & 0x1;
+
+		if (finger->active != active) {
+			finger->active = active;
+			state->dirty |= BIT(i);
+		}
+
+		if (!active && finger->valid) {
 			/*
 			 * Even when the finger becomes active again, we still
 			 * will have to wait for the first valid position.
 			 */
-			state->fingers[i].valid = false;
+			finger->valid = false;
+			state->dirty |= BIT(i);
 		}
 		fingers >>= 1;
 	}
@@ -185,7 +233,8 @@ static void focaltech_process_abs_packet(struct psmouse *psmouse,
 {
 	struct focaltech_data *priv = psmouse->private;
 	struct focaltech_hw_state *state = &priv->state;
-	unsigned int finger;
+	struct focaltech_finger_state *f;
+	unsigned int finger, x, y, width;
 
 	finger = (packet[1] >> 4) - 1;
 	if (finger >= FOC_MAX_FINGERS) {
@@ -196,10 +245,57 @@ static void focaltech_process_abs_packet(struct psmouse *psmouse,
 
 	state->pressed = (packet[0] >> 4) & 1;
 
-	state->fingers[finger].x = ((packet[1] & 0xf) << 8) | packet[2];
-	state->fingers[finger].y = (packet[3] << 8) | packet[4];
-	state->width = packet[5] >> 4;
-	state->fingers[finger].valid = true;
+	f = &state->fingers[finger];
+	x = ((packet[1] & 0xf) << 8) | packet[2];
+	y = (packet[3] << 8) | packet[4];
+	width = packet[5] >> 4;
+
+	if (f->valid) {
+		unsigned int age = jiffies_to_msecs(jiffies - f->anchor_time);
+
+		if (abs((int)x - (int)f->x) + abs((int)y - (int)f->y) >
+		    FOC_DRIFT_THRESHOLD)
+			priv->drift_corrections++;
+
+		priv->max_anchor_age = max(priv->max_anchor_age, age);
+	}
+	f->anchor_time = jiffies;
+
+	if (!f->valid || f->x != x || f->y != y || state->width != width)
+		state->dirty |= BIT(finger);
+
+	f->x = x;
+	f->y = y;
+	state->width = width;
+	f->valid = true;
+}
+
+/*
+ * Move a finger by a relative delta. There is nothing to integrate onto
+ * until the first absolute packet for the finger, and the result is kept
+ * on the touchpad so that it can not wrap around.
+ */
+static void focaltech_apply_rel(struct focaltech_data *priv, int finger,
+				signed char dx, signed char dy)
+{
+	struct focaltech_hw_state *state = &priv->state;
+	struct focaltech_finger_state *f = &state->fingers[finger];
+	int x, y;
+
+	if (!f->valid || (!dx && !dy))
+		return;
+
+	x = f->x + dx;
+	y = f->y + dy;
+	if (x < 0 || x > priv->x_max || y < 0 || y > priv->y_max) {
+		x = clamp(x, 0, (int)priv->x_max);
+		y = clamp(y, 0, (int)priv->y_max);
+		priv->clamp_corrections++;
+	}
+
+	f->x = x;
+	f->y = y;
+	state->dirty |= BIT(finger);
 }
 
 static void focaltech_process_rel_packet(struct psmouse *psmouse,
@@ -207,16 +303,15 @@ static void focaltech_process_rel_packet(struct psmouse *psmouse,
 {
 	struct focaltech_data *priv = psmouse->private;
 	struct focaltech_hw_state *state = &priv->state;
-	int finger1, finger2;
+	unsigned int finger1, finger2;
 
 	state->pressed = packet[0] >> 7;
 	finger1 = ((packet[0] >> 4) & 0x7) - 1;
 	if (finger1 < FOC_MAX_FINGERS) {
-		state->fingers[finger1].x += (char)packet[1];
-		state->fingers[finger1].y += (char)packet[2];
+		focaltech_apply_rel(priv, finger1, packet[1], packet[2]);
 	} else {
 		psmouse_err(psmouse, "First finger in rel packet invalid: %d\n",
-			    finger1);
+			    (int)finger1);
 	}
 
 	/*
@@ -227,10 +322,8 @@ static void focaltech_process_rel_packet(struct psmouse *psmouse,
 	 * and be above FOC_MAX_FINGERS).
 	 */
 	finger2 = ((packet[3] >> 4) & 0x7) - 1;
-	if (finger2 < FOC_MAX_FINGERS) {
-		state->fingers[finger2].x += (char)packet[4];
-		state->fingers[finger2].y += (char)packet[5];
-	}
+	if (finger2 < FOC_MAX_FINGERS)
+		focaltech_apply_rel(priv, finger2, packet[4], packet[5]);
 }
 
 static void focaltech_process_packet(struct psmouse *psmouse)
@@ -300,8 +393,47 @@ static int focaltech_switch_protocol(struct psmouse *psmouse)
 	return 0;
 }
 
+static ssize_t focaltech_show_counter(struct psmouse *psmouse, void *data,
+				      char *buf)
+{
+	struct focaltech_data *priv = psmouse->private;
+	unsigned long *counter = (unsigned long *)((char *)priv + (size_t)data);
+
+	return sprintf(buf, "%lu\n", *counter);
+}
+
+static ssize_t focaltech_show_max_anchor_age(struct psmouse *psmouse,
+					     void *data, char *buf)
+{
+	struct focaltech_data *priv = psmouse->private;
+
+	return sprintf(buf, "%u\n", priv->max_anchor_age);
+}
+
+PSMOUSE_DEFINE_RO_ATTR(drift_corrections, S_IRUGO,
+		       (void *)offsetof(struct focaltech_data, drift_corrections),
+		       focaltech_show_counter);
+PSMOUSE_DEFINE_RO_ATTR(clamp_corrections, S_IRUGO,
+		       (void *)offsetof(struct focaltech_data, clamp_corrections),
+		       focaltech_show_counter);
+PSMOUSE_DEFINE_RO_ATTR(max_anchor_age, S_IRUGO, NULL,
+		       focaltech_show_max_anchor_age);
+
+static struct attribute *focaltech_attrs[] = {
+	&psmouse_attr_drift_corrections.dattr.attr,
+	&psmouse_attr_clamp_corrections.dattr.attr,
+	&psmouse_attr_max_anchor_age.dattr.attr,
+	NULL
+};
+
+static struct attribute_group focaltech_attr_group = {
+	.attrs = focaltech_attrs,
+};
+
 static void focaltech_disconnect(struct psmouse *psmouse)
 {
+	sysfs_remove_group(&psmouse->ps2dev.serio->dev.kobj,
+			   &focaltech_attr_group);
 	focaltech_reset(psmouse);
 	kfree(psmouse->private);
 	psmouse->private = NULL;
@@ -433,6 +565,15 @@ int focaltech_init(struct psmouse *psmouse)
 
 	focaltech_set_input_params(psmouse);
 
+	error = sysfs_create_group(&psmouse->ps2dev.serio->dev.kobj,
+				   &focaltech_attr_group);
+	if (error) {
+		psmouse_err(psmouse,
+			    "failed to create sysfs attributes, error: %d\n",
+			    error);
+		goto fail;
+	}
+
 	psmouse->protocol_handler = focaltech_process_byte;
 	psmouse->pktsize = 6;
 	psmouse->disconnect = focaltech_disconnect;
@@ -457,6 +598,31 @@ fail:
 	return error;
 }
 
+#ifdef CONFIG_MOUSE_PS2_TEST
+/*
+ * Fixture for psmouse_test.ko; @model is the size as the touchpad
+ * reports it to focaltech_read_size(), x in bits 15-8 and y in 7-0.
+ */
+int focaltech_test_init(struct psmouse *psmouse, unsigned int model)
+{
+	struct focaltech_data *priv;
+
+	psmouse->private = priv = kzalloc(sizeof(struct focaltech_data),
+					  GFP_KERNEL);
+	if (!priv)
+		return -ENOMEM;
+
+	priv->x_max = ((model >> 8) & 0xff) * 128;
+	priv->y_max = (model & 0xff) * 128;
+	focaltech_set_input_params(psmouse);
+
+	psmouse->protocol_handler = focaltech_process_byte;
+	psmouse->pktsize = 6;
+
+	return 0;
+}
+#endif
+
 #else /* CONFIG_MOUSE_PS2_FOCALTECH */
 
 int focaltech_init(struct psmouse *psmouse)
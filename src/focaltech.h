@@ -20,4 +20,8 @@
 int focaltech_detect(struct psmouse *psmouse, bool set_properties);
 int focaltech_init(struct psmouse *psmouse);
 
+#ifdef CONFIG_MOUSE_PS2_TEST
+int focaltech_test_init(struct psmouse *psmouse, unsigned int model);
+#endif
+
 #endif
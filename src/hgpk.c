@@ -36,6 +36,7 @@
 #include <linux/serio.h>
 #include <linux/libps2.h>
 #include <linux/delay.h>
+#include <linux/ktime.h>
 #include <asm/olpc.h>
 
 #include "psmouse.h"
@@ -63,6 +64,26 @@ module_param(spew_delay, int, 0644);
 MODULE_PARM_DESC(spew_delay,
 	"delay (ms) before recal after packet spew detected");
 
+static int spew_window = SPEW_WATCH_COUNT;
+module_param(spew_window, int, 0644);
+MODULE_PARM_DESC(spew_window,
+	"number of packets (2-64) examined by packet spew detection");
+
+static int spew_delta = 3;
+module_param(spew_delta, int, 0644);
+MODULE_PARM_DESC(spew_delta,
+	"largest per-packet delta that is still considered packet spew");
+
+static int spew_drift = 3;
+module_param(spew_drift, int, 0644);
+MODULE_PARM_DESC(spew_drift,
+	"spew is only reported if net motion over the window stays below this");
+
+static int spew_check_time = 200;
+module_param(spew_check_time, int, 0644);
+MODULE_PARM_DESC(spew_check_time,
+	"interval (ms) after a spew recal in which packets mark it a false positive");
+
 static int recal_guard_time;
 module_param(recal_guard_time, int, 0644);
 MODULE_PARM_DESC(recal_guard_time,
@@ -77,6 +98,11 @@ static bool autorecal = true;
 module_param(autorecal, bool, 0644);
 MODULE_PARM_DESC(autorecal, "enable recalibration in the driver");
 
+static bool recal_reset = true;
+module_param(recal_reset, bool, 0644);
+MODULE_PARM_DESC(recal_reset,
+	"reset the touchpad before recalibrating; off keeps it in command mode instead, skipping the reset delay");
+
 static char hgpk_mode_name[16];
 module_param_string(hgpk_mode, hgpk_mode_name, sizeof(hgpk_mode_name), 0644);
 MODULE_PARM_DESC(hgpk_mode,
@@ -179,12 +205,42 @@ static int hgpk_discard_decay_hack(struct psmouse *psmouse, int x, int y)
 static void hgpk_reset_spew_detection(struct hgpk_data *priv)
 {
 	priv->spew_count = 0;
+	priv->spew_head = 0;
 	priv->dupe_count = 0;
 	priv->x_tally = 0;
 	priv->y_tally = 0;
 	priv->spew_flag = NO_SPEW;
 }
 
+/*
+ * Add a delta to the spew window.  x_tally/y_tally always hold the sum
+ * of the last spew_count deltas, so once the window is full the oldest
+ * delta is dropped as the new one is added.  spew_count only grows here,
+ * and the ring is filled from spew_head 0 after every reset, so the slot
+ * dropped is always one written since the last reset.
+ */
+static void hgpk_spew_window_add(struct hgpk_data *priv,
+				 int x, int y, int window)
+{
+	unsigned int tail;
+
+	if (priv->spew_count >= window) {
+		tail = (priv->spew_head + SPEW_WINDOW_MAX - window) %
+			SPEW_WINDOW_MAX;
+		priv->x_tally -= priv->spew_dx[tail];
+		priv->y_tally -= priv->spew_dy[tail];
+	} else {
+		priv->spew_count++;
+	}
+
+	priv->spew_dx[priv->spew_head] = x;
+	priv->spew_dy[priv->spew_head] = y;
+	priv->spew_head = (priv->spew_head + 1) % SPEW_WINDOW_MAX;
+
+	priv->x_tally += x;
+	priv->y_tally += y;
+}
+
 static void hgpk_reset_hack_state(struct psmouse *psmouse)
 {
 	struct hgpk_data *priv = psmouse->private;
@@ -210,11 +266,17 @@ static void hgpk_reset_hack_state(struct psmouse *psmouse)
  * pretty regularly when the touchpad is spewing, and is pretty hard to
  * manually trigger (at least for *my* fingers).  So, it makes a perfect
  * scheme for detecting spews.
+ *
+ * The tally is kept over a sliding window of the last spew_window small
+ * deltas, so a slow deliberate movement that happens to start with a
+ * few jittery packets does not keep the sum near 0 forever.
  */
 static void hgpk_spewing_hack(struct psmouse *psmouse,
 			      int l, int r, int x, int y)
 {
 	struct hgpk_data *priv = psmouse->private;
+	int window = clamp(spew_window, 2, SPEW_WINDOW_MAX);
+	int delta = clamp(spew_delta, 0, 127);
 
 	/* ignore button press packets; many in a row could trigger
 	 * a false-positive! */
@@ -225,16 +287,19 @@ static void hgpk_spewing_hack(struct psmouse *psmouse,
 	if (!spew_delay)
 		return;
 
-	if (abs(x) > 3 || abs(y) > 3) {
+	if (abs(x) > delta || abs(y) > delta) {
 		/* no spew, or spew ended */
 		hgpk_reset_spew_detection(priv);
 		return;
 	}
 
+	/* spew_window was shrunk under us, start over */
+	if (priv->spew_count > window)
+		hgpk_reset_spew_detection(priv);
+
 	/* Keep a tally of the overall delta to the cursor position caused by
 	 * the spew */
-	priv->x_tally += x;
-	priv->y_tally += y;
+	hgpk_spew_window_add(priv, x, y, window);
 
 	switch (priv->spew_flag) {
 	case NO_SPEW:
@@ -244,9 +309,7 @@ static void hgpk_spewing_hack(struct psmouse *psmouse,
 		/* fall-through */
 
 	case MAYBE_SPEWING:
-		priv->spew_count++;
-
-		if (priv->spew_count < SPEW_WATCH_COUNT)
+		if (priv->spew_count < window)
 			break;
 
 		/* excessive spew detected, request recalibration */
@@ -259,10 +322,12 @@ static void hgpk_spewing_hack(struct psmouse *psmouse,
 		 * is really small. if the spew is causing significant cursor
 		 * movement, it is probably a case of the user moving the
 		 * cursor very slowly across the screen. */
-		if (abs(priv->x_tally) < 3 && abs(priv->y_tally) < 3) {
+		if (abs(priv->x_tally) < spew_drift &&
+		    abs(priv->y_tally) < spew_drift) {
 			psmouse_warn(psmouse, "packet spew detected (%d,%d)\n",
 				     priv->x_tally, priv->y_tally);
 			priv->spew_flag = RECALIBRATING;
+			priv->spew_recal = true;
 			psmouse_queue_work(psmouse, &priv->recalib_wq,
 					   msecs_to_jiffies(spew_delay));
 		}
@@ -395,6 +460,7 @@ static void hgpk_process_advanced_packet(struct psmouse *psmouse)
 			if (tpdebug)
 				psmouse_dbg(psmouse, "hard spew detected\n");
 			priv->spew_flag = RECALIBRATING;
+			priv->spew_recal = true;
 			psmouse_queue_work(psmouse, &priv->recalib_wq,
 					   msecs_to_jiffies(spew_delay));
 		}
@@ -489,6 +555,19 @@ static psmouse_ret_t hgpk_process_byte(struct psmouse *psmouse)
 		priv->recalib_window = 0;
 	}
 
+	if (priv->spew_check_window) {
+		if (time_before(jiffies, priv->spew_check_window)) {
+			/*
+			 * A spewing pad stays quiet after recalibration;
+			 * packets this early mean a finger was moving.
+			 */
+			psmouse_dbg(psmouse,
+				    "packet right after spew recalibration, counting false positive\n");
+			priv->false_positives++;
+		}
+		priv->spew_check_window = 0;
+	}
+
 	return PSMOUSE_GOOD_DATA;
 }
 
@@ -603,26 +682,33 @@ static void hgpk_setup_input_device(struct input_dev *input,
 	}
 }
 
-static int hgpk_reset_device(struct psmouse *psmouse, bool recalibrate)
+static int hgpk_send_recalibrate(struct psmouse *psmouse)
 {
-	int err;
+	struct ps2dev *ps2dev = &psmouse->ps2dev;
 
-	psmouse_reset(psmouse);
+	/* send the recalibrate request */
+	if (ps2_command(ps2dev, NULL, 0xf5) ||
+	    ps2_command(ps2dev, NULL, 0xf5) ||
+	    ps2_command(ps2dev, NULL, 0xe6) ||
+	    ps2_command(ps2dev, NULL, 0xf5)) {
+		return -1;
+	}
 
-	if (recalibrate) {
-		struct ps2dev *ps2dev = &psmouse->ps2dev;
+	/* according to ALPS, 150mS is required for recalibration */
+	msleep(150);
 
-		/* send the recalibrate request */
-		if (ps2_command(ps2dev, NULL, 0xf5) ||
-		    ps2_command(ps2dev, NULL, 0xf5) ||
-		    ps2_command(ps2dev, NULL, 0xe6) ||
-		    ps2_command(ps2dev, NULL, 0xf5)) {
-			return -1;
-		}
+	return 0;
+}
 
-		/* according to ALPS, 150mS is required for recalibration */
-		msleep(150);
-	}
+static int hgpk_reset_device(struct psmouse *psmouse, bool recalibrate)
+{
+	int err;
+
+	if (recal_reset || !recalibrate)
+		psmouse_reset(psmouse);
+
+	if (recalibrate && hgpk_send_recalibrate(psmouse))
+		return -1;
 
 	err = hgpk_select_mode(psmouse);
 	if (err) {
@@ -635,9 +721,11 @@ static int hgpk_reset_device(struct psmouse *psmouse, bool recalibrate)
 	return 0;
 }
 
-static int hgpk_force_recalibrate(struct psmouse *psmouse)
+static int hgpk_force_recalibrate(struct psmouse *psmouse, bool spew)
 {
 	struct hgpk_data *priv = psmouse->private;
+	ktime_t start;
+	unsigned int duration;
 	int err;
 
 	/* C-series touchpads added the recalibrate command */
@@ -651,10 +739,19 @@ static int hgpk_force_recalibrate(struct psmouse *psmouse)
 
 	psmouse_dbg(psmouse, "recalibrating touchpad..\n");
 
-	/* we don't want to race with the irq handler, nor with resyncs */
-	psmouse_set_state(psmouse, PSMOUSE_INITIALIZING);
+	start = ktime_get();
 
-	/* start by resetting the device */
+	/*
+	 * We don't want to race with the irq handler, nor with resyncs.
+	 * Without the reset there is no BAT to swallow, so disabling the
+	 * stream and staying in command mode is enough.
+	 */
+	if (recal_reset)
+		psmouse_set_state(psmouse, PSMOUSE_INITIALIZING);
+	else if (psmouse_deactivate(psmouse))
+		return -1;
+
+	/* start by resetting the device, unless told not to */
 	err = hgpk_reset_device(psmouse, true);
 	if (err)
 		return err;
@@ -665,11 +762,25 @@ static int hgpk_force_recalibrate(struct psmouse *psmouse)
 	 * we don't have a good way to deal with it.  The 2s window stuff
 	 * (below) is our best option for now.
 	 */
+	if (spew && spew_check_time)
+		priv->spew_check_window = jiffies +
+			msecs_to_jiffies(spew_check_time);
+
 	if (psmouse_activate(psmouse))
 		return -1;
 
+	duration = ktime_us_delta(ktime_get(), start);
+	priv->recalibrations++;
+	if (spew)
+		priv->spew_recalibrations++;
+	priv->recal_last_us = duration;
+	priv->recal_total_us += duration;
+	if (duration > priv->recal_max_us)
+		priv->recal_max_us = duration;
+
 	if (tpdebug)
-		psmouse_dbg(psmouse, "touchpad reactivated\n");
+		psmouse_dbg(psmouse, "touchpad reactivated after %u us\n",
+			    duration);
 
 	/*
 	 * If we get packets right away after recalibrating, it's likely
@@ -898,6 +1009,49 @@ static ssize_t hgpk_trigger_recal(struct psmouse *psmouse, void *data,
 __PSMOUSE_DEFINE_ATTR(recalibrate, S_IWUSR | S_IRUGO, NULL,
 		      hgpk_trigger_recal_show, hgpk_trigger_recal, false);
 
+static ssize_t hgpk_show_counter(struct psmouse *psmouse, void *data,
+				 char *buf)
+{
+	struct hgpk_data *priv = psmouse->private;
+	unsigned long *counter = (unsigned long *)((char *)priv + (size_t)data);
+
+	return sprintf(buf, "%lu\n", *counter);
+}
+
+static ssize_t hgpk_show_recal_time(struct psmouse *psmouse, void *data,
+				    char *buf)
+{
+	struct hgpk_data *priv = psmouse->private;
+
+	return sprintf(buf, "%u %u %llu\n", priv->recal_last_us,
+		       priv->recal_max_us,
+		       (unsigned long long)priv->recal_total_us);
+}
+
+PSMOUSE_DEFINE_RO_ATTR(recalibrations, S_IRUGO,
+		       (void *)offsetof(struct hgpk_data, recalibrations),
+		       hgpk_show_counter);
+PSMOUSE_DEFINE_RO_ATTR(spew_recalibrations, S_IRUGO,
+		       (void *)offsetof(struct hgpk_data, spew_recalibrations),
+		       hgpk_show_counter);
+PSMOUSE_DEFINE_RO_ATTR(false_positives, S_IRUGO,
+		       (void *)offsetof(struct hgpk_data, false_positives),
+		       hgpk_show_counter);
+/* last, longest and total recalibration time, in microseconds */
+PSMOUSE_DEFINE_RO_ATTR(recal_time, S_IRUGO, NULL, hgpk_show_recal_time);
+
+static struct attribute *hgpk_recal_attrs[] = {
+	&psmouse_attr_recalibrations.dattr.attr,
+	&psmouse_attr_spew_recalibrations.dattr.attr,
+	&psmouse_attr_false_positives.dattr.attr,
+	&psmouse_attr_recal_time.dattr.attr,
+	NULL
+};
+
+static struct attribute_group hgpk_recal_attr_group = {
+	.attrs = hgpk_recal_attrs,
+};
+
 static void hgpk_disconnect(struct psmouse *psmouse)
 {
 	struct hgpk_data *priv = psmouse->private;
@@ -907,9 +1061,12 @@ static void hgpk_disconnect(struct psmouse *psmouse)
 	device_remove_file(&psmouse->ps2dev.serio->dev,
 			   &psmouse_attr_hgpk_mode.dattr);
 
-	if (psmouse->model >= HGPK_MODEL_C)
+	if (psmouse->model >= HGPK_MODEL_C) {
+		sysfs_remove_group(&psmouse->ps2dev.serio->dev.kobj,
+				   &hgpk_recal_attr_group);
 		device_remove_file(&psmouse->ps2dev.serio->dev,
 				   &psmouse_attr_recalibrate.dattr);
+	}
 
 	psmouse_reset(psmouse);
 	kfree(priv);
@@ -920,8 +1077,11 @@ static void hgpk_recalib_work(struct work_struct *work)
 	struct delayed_work *w = to_delayed_work(work);
 	struct hgpk_data *priv = container_of(w, struct hgpk_data, recalib_wq);
 	struct psmouse *psmouse = priv->psmouse;
+	bool spew = priv->spew_recal;
 
-	if (hgpk_force_recalibrate(psmouse))
+	priv->spew_recal = false;
+
+	if (hgpk_force_recalibrate(psmouse, spew))
 		psmouse_err(psmouse, "recalibration failed!\n");
 }
 
@@ -967,10 +1127,21 @@ static int hgpk_register(struct psmouse *psmouse)
 				    "Failed creating 'recalibrate' sysfs node\n");
 			goto err_remove_mode;
 		}
+
+		err = sysfs_create_group(&psmouse->ps2dev.serio->dev.kobj,
+					 &hgpk_recal_attr_group);
+		if (err) {
+			psmouse_err(psmouse,
+				    "Failed creating recalibration stats sysfs nodes\n");
+			goto err_remove_recal;
+		}
 	}
 
 	return 0;
 
+err_remove_recal:
+	device_remove_file(&psmouse->ps2dev.serio->dev,
+			   &psmouse_attr_recalibrate.dattr);
 err_remove_mode:
 	device_remove_file(&psmouse->ps2dev.serio->dev,
 			   &psmouse_attr_hgpk_mode.dattr);
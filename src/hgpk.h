@@ -24,6 +24,7 @@ enum hgpk_spew_flag {
 };
 
 #define SPEW_WATCH_COUNT 42  /* at 12ms/packet, this is 1/2 second */
+#define SPEW_WINDOW_MAX 64   /* size of the spew detection delta ring */
 
 enum hgpk_mode {
 	HGPK_MODE_MOUSE,
@@ -38,8 +39,17 @@ struct hgpk_data {
 	bool powered;
 	enum hgpk_spew_flag spew_flag;
 	int spew_count, x_tally, y_tally;	/* spew detection */
+	unsigned int spew_head;
+	signed char spew_dx[SPEW_WINDOW_MAX], spew_dy[SPEW_WINDOW_MAX];
+	bool spew_recal;			/* spew queued recalib_wq */
 	unsigned long recalib_window;
+	unsigned long spew_check_window;
 	struct delayed_work recalib_wq;
+	unsigned long recalibrations;		/* recalibration stats */
+	unsigned long spew_recalibrations;
+	unsigned long false_positives;
+	unsigned int recal_last_us, recal_max_us;
+	u64 recal_total_us;
 	int abs_x, abs_y;
 	int dupe_count;
 	int xbigj, ybigj, xlast, ylast; /* jumpiness detection */
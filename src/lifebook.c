@@ -24,8 +24,39 @@
 struct lifebook_data {
 	struct input_dev *dev2;		/* Relative device */
 	char phys[32];
+	unsigned char buttons;		/* Last buttons reported on dev2 */
 };
 
+/*
+ * Validity of each byte of the 6-byte absolute packet.  A byte is good
+ * when, after masking, it matches the expected value, its bits 5-4 repeat
+ * in bits 7-6 (pair_mask), and its bits 7-6 match those of an earlier
+ * byte (ref/ref_mask).
+ */
+struct lifebook_byte_check {
+	unsigned char mask, expect;
+	unsigned char pair_mask;
+	unsigned char ref, ref_mask;
+};
+
+static const struct lifebook_byte_check lifebook_6byte_checks[6] = {
+	[0] = { .mask = 0xf8, .expect = 0x00 },
+	[2] = { .pair_mask = 0xc0 },
+	[3] = { .mask = 0xf8, .expect = 0xc0 },
+	[4] = { .ref = 2, .ref_mask = 0xc0 },
+	[5] = { .pair_mask = 0xc0, .ref = 1, .ref_mask = 0xc0 },
+};
+
+static bool lifebook_6byte_valid(const unsigned char *packet, int idx)
+{
+	const struct lifebook_byte_check *c = &lifebook_6byte_checks[idx];
+	unsigned char b = packet[idx];
+
+	return !(((b & c->mask) ^ c->expect) |
+		 ((b ^ (b << 2)) & c->pair_mask) |
+		 ((b ^ packet[c->ref]) & c->ref_mask));
+}
+
 static bool lifebook_present;
 
 static const char *desired_serio_phys;
@@ -143,28 +174,10 @@ static psmouse_ret_t lifebook_process_byte(struct psmouse *psmouse)
 		if (psmouse->pktcnt != 3)
 			return PSMOUSE_GOOD_DATA;
 	} else {
-		switch (psmouse->pktcnt) {
-		case 1:
-			return (packet[0] & 0xf8) == 0x00 ?
-				PSMOUSE_GOOD_DATA : PSMOUSE_BAD_DATA;
-		case 2:
+		if (!lifebook_6byte_valid(packet, psmouse->pktcnt - 1))
+			return PSMOUSE_BAD_DATA;
+		if (psmouse->pktcnt != 6)
 			return PSMOUSE_GOOD_DATA;
-		case 3:
-			return ((packet[2] & 0x30) << 2) == (packet[2] & 0xc0) ?
-				PSMOUSE_GOOD_DATA : PSMOUSE_BAD_DATA;
-		case 4:
-			return (packet[3] & 0xf8) == 0xc0 ?
-				PSMOUSE_GOOD_DATA : PSMOUSE_BAD_DATA;
-		case 5:
-			return (packet[4] & 0xc0) == (packet[2] & 0xc0) ?
-				PSMOUSE_GOOD_DATA : PSMOUSE_BAD_DATA;
-		case 6:
-			if (((packet[5] & 0x30) << 2) != (packet[5] & 0xc0))
-				return PSMOUSE_BAD_DATA;
-			if ((packet[5] & 0xc0) != (packet[1] & 0xc0))
-				return PSMOUSE_BAD_DATA;
-			break; /* report data */
-		}
 	}
 
 	if (relative_packet) {
@@ -187,7 +200,8 @@ static psmouse_ret_t lifebook_process_byte(struct psmouse *psmouse)
 		input_sync(dev1);
 	}
 
-	if (dev2) {
+	/* Absolute packets only matter to dev2 when the buttons change */
+	if (dev2 && (relative_packet || (packet[0] & 0x03) != priv->buttons)) {
 		if (relative_packet) {
 			input_report_rel(dev2, REL_X,
 				((packet[0] & 0x10) ? packet[1] - 256 : packet[1]));
@@ -197,6 +211,7 @@ static psmouse_ret_t lifebook_process_byte(struct psmouse *psmouse)
 		input_report_key(dev2, BTN_LEFT, packet[0] & 0x01);
 		input_report_key(dev2, BTN_RIGHT, packet[0] & 0x02);
 		input_sync(dev2);
+		priv->buttons = packet[0] & 0x03;
 	}
 
 	return PSMOUSE_FULL_PACKET;
@@ -312,20 +327,25 @@ static int lifebook_create_relative_device(struct psmouse *psmouse)
 	return error;
 }
 
-int lifebook_init(struct psmouse *psmouse)
+static void lifebook_set_input_params(struct psmouse *psmouse)
 {
 	struct input_dev *dev1 = psmouse->dev;
 	int max_coord = lifebook_use_6byte_proto ? 4096 : 1024;
 
-	if (lifebook_absolute_mode(psmouse))
-		return -1;
-
 	dev1->evbit[0] = BIT_MASK(EV_ABS) | BIT_MASK(EV_KEY);
 	dev1->relbit[0] = 0;
 	dev1->keybit[BIT_WORD(BTN_MOUSE)] = 0;
 	dev1->keybit[BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH);
 	input_set_abs_params(dev1, ABS_X, 0, max_coord, 0, 0);
 	input_set_abs_params(dev1, ABS_Y, 0, max_coord, 0, 0);
+}
+
+int lifebook_init(struct psmouse *psmouse)
+{
+	if (lifebook_absolute_mode(psmouse))
+		return -1;
+
+	lifebook_set_input_params(psmouse);
 
 	if (!desired_serio_phys) {
 		if (lifebook_create_relative_device(psmouse)) {
@@ -350,3 +370,31 @@ int lifebook_init(struct psmouse *psmouse)
 	return 0;
 }
 
+#ifdef CONFIG_MOUSE_PS2_TEST
+/*
+ * Fixture for psmouse_test.ko; @model is the packet size, 3 or 6. The
+ * packet format is global, so this must not be used while a real
+ * touchscreen is bound.
+ */
+int lifebook_test_init(struct psmouse *psmouse, unsigned int model)
+{
+	int error;
+
+	if (model != 3 && model != 6)
+		return -EINVAL;
+
+	lifebook_use_6byte_proto = model == 6;
+	lifebook_set_input_params(psmouse);
+
+	error = lifebook_create_relative_device(psmouse);
+	if (error)
+		return error;
+
+	psmouse->protocol_handler = lifebook_process_byte;
+	psmouse->disconnect = lifebook_disconnect;
+	psmouse->model = model;
+	psmouse->pktsize = 3;
+
+	return 0;
+}
+#endif
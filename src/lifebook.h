@@ -29,4 +29,8 @@ static inline int lifebook_init(struct psmouse *psmouse)
 }
 #endif
 
+#ifdef CONFIG_MOUSE_PS2_TEST
+int lifebook_test_init(struct psmouse *psmouse, unsigned int model);
+#endif
+
 #endif
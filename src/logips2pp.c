@@ -201,61 +201,69 @@ static void ps2pp_disconnect(struct psmouse *psmouse)
 
 static const struct ps2pp_info *get_model_info(unsigned char model)
 {
-	static const struct ps2pp_info ps2pp_list[] = {
-		{  1,	0,			0 },	/* Simple 2-button mouse */
-		{ 12,	0,			PS2PP_SIDE_BTN},
-		{ 13,	0,			0 },
-		{ 15,	PS2PP_KIND_MX,					/* MX1000 */
+	/*
+	 * Indexed by model number (which is 7 bits wide); slots for
+	 * unknown models are left zeroed. There is no model 0, so a
+	 * zero model field marks an empty slot, including slot 0.
+	 */
+#define PS2PP_MODEL(_model, _kind, _features)	\
+	[_model] = { _model, _kind, _features }
+
+	static const struct ps2pp_info ps2pp_list[128] = {
+		PS2PP_MODEL(  1, 0,			0 ),	/* Simple 2-button mouse */
+		PS2PP_MODEL( 12, 0,			PS2PP_SIDE_BTN),
+		PS2PP_MODEL( 13, 0,			0 ),
+		PS2PP_MODEL( 15, PS2PP_KIND_MX,				/* MX1000 */
 				PS2PP_WHEEL | PS2PP_SIDE_BTN | PS2PP_TASK_BTN |
-				PS2PP_EXTRA_BTN | PS2PP_NAV_BTN | PS2PP_HWHEEL },
-		{ 40,	0,			PS2PP_SIDE_BTN },
-		{ 41,	0,			PS2PP_SIDE_BTN },
-		{ 42,	0,			PS2PP_SIDE_BTN },
-		{ 43,	0,			PS2PP_SIDE_BTN },
-		{ 50,	0,			0 },
-		{ 51,	0,			0 },
-		{ 52,	PS2PP_KIND_WHEEL,	PS2PP_SIDE_BTN | PS2PP_WHEEL },
-		{ 53,	PS2PP_KIND_WHEEL,	PS2PP_WHEEL },
-		{ 56,	PS2PP_KIND_WHEEL,	PS2PP_SIDE_BTN | PS2PP_WHEEL }, /* Cordless MouseMan Wheel */
-		{ 61,	PS2PP_KIND_MX,					/* MX700 */
+				PS2PP_EXTRA_BTN | PS2PP_NAV_BTN | PS2PP_HWHEEL ),
+		PS2PP_MODEL( 40, 0,			PS2PP_SIDE_BTN ),
+		PS2PP_MODEL( 41, 0,			PS2PP_SIDE_BTN ),
+		PS2PP_MODEL( 42, 0,			PS2PP_SIDE_BTN ),
+		PS2PP_MODEL( 43, 0,			PS2PP_SIDE_BTN ),
+		PS2PP_MODEL( 50, 0,			0 ),
+		PS2PP_MODEL( 51, 0,			0 ),
+		PS2PP_MODEL( 52, PS2PP_KIND_WHEEL,	PS2PP_SIDE_BTN | PS2PP_WHEEL ),
+		PS2PP_MODEL( 53, PS2PP_KIND_WHEEL,	PS2PP_WHEEL ),
+		PS2PP_MODEL( 56, PS2PP_KIND_WHEEL,	PS2PP_SIDE_BTN | PS2PP_WHEEL ), /* Cordless MouseMan Wheel */
+		PS2PP_MODEL( 61, PS2PP_KIND_MX,				/* MX700 */
 				PS2PP_WHEEL | PS2PP_SIDE_BTN | PS2PP_TASK_BTN |
-				PS2PP_EXTRA_BTN | PS2PP_NAV_BTN },
-		{ 66,	PS2PP_KIND_MX,					/* MX3100 receiver */
+				PS2PP_EXTRA_BTN | PS2PP_NAV_BTN ),
+		PS2PP_MODEL( 66, PS2PP_KIND_MX,				/* MX3100 receiver */
 				PS2PP_WHEEL | PS2PP_SIDE_BTN | PS2PP_TASK_BTN |
-				PS2PP_EXTRA_BTN | PS2PP_NAV_BTN | PS2PP_HWHEEL },
-		{ 72,	PS2PP_KIND_TRACKMAN,	0 },			/* T-CH11: TrackMan Marble */
-		{ 73,	PS2PP_KIND_TRACKMAN,	PS2PP_SIDE_BTN },	/* TrackMan FX */
-		{ 75,	PS2PP_KIND_WHEEL,	PS2PP_WHEEL },
-		{ 76,	PS2PP_KIND_WHEEL,	PS2PP_WHEEL },
-		{ 79,	PS2PP_KIND_TRACKMAN,	PS2PP_WHEEL },		/* TrackMan with wheel */
-		{ 80,	PS2PP_KIND_WHEEL,	PS2PP_SIDE_BTN | PS2PP_WHEEL },
-		{ 81,	PS2PP_KIND_WHEEL,	PS2PP_WHEEL },
-		{ 83,	PS2PP_KIND_WHEEL,	PS2PP_WHEEL },
-		{ 85,	PS2PP_KIND_WHEEL,	PS2PP_WHEEL },
-		{ 86,	PS2PP_KIND_WHEEL,	PS2PP_WHEEL },
-		{ 87,	PS2PP_KIND_WHEEL,	PS2PP_WHEEL },
-		{ 88,	PS2PP_KIND_WHEEL,	PS2PP_WHEEL },
-		{ 96,	0,			0 },
-		{ 97,	PS2PP_KIND_TP3,		PS2PP_WHEEL | PS2PP_HWHEEL },
-		{ 99,	PS2PP_KIND_WHEEL,	PS2PP_WHEEL },
-		{ 100,	PS2PP_KIND_MX,					/* MX510 */
+				PS2PP_EXTRA_BTN | PS2PP_NAV_BTN | PS2PP_HWHEEL ),
+		PS2PP_MODEL( 72, PS2PP_KIND_TRACKMAN,	0 ),			/* T-CH11: TrackMan Marble */
+		PS2PP_MODEL( 73, PS2PP_KIND_TRACKMAN,	PS2PP_SIDE_BTN ),	/* TrackMan FX */
+		PS2PP_MODEL( 75, PS2PP_KIND_WHEEL,	PS2PP_WHEEL ),
+		PS2PP_MODEL( 76, PS2PP_KIND_WHEEL,	PS2PP_WHEEL ),
+		PS2PP_MODEL( 79, PS2PP_KIND_TRACKMAN,	PS2PP_WHEEL ),		/* TrackMan with wheel */
+		PS2PP_MODEL( 80, PS2PP_KIND_WHEEL,	PS2PP_SIDE_BTN | PS2PP_WHEEL ),
+		PS2PP_MODEL( 81, PS2PP_KIND_WHEEL,	PS2PP_WHEEL ),
+		PS2PP_MODEL( 83, PS2PP_KIND_WHEEL,	PS2PP_WHEEL ),
+		PS2PP_MODEL( 85, PS2PP_KIND_WHEEL,	PS2PP_WHEEL ),
+		PS2PP_MODEL( 86, PS2PP_KIND_WHEEL,	PS2PP_WHEEL ),
+		PS2PP_MODEL( 87, PS2PP_KIND_WHEEL,	PS2PP_WHEEL ),
+		PS2PP_MODEL( 88, PS2PP_KIND_WHEEL,	PS2PP_WHEEL ),
+		PS2PP_MODEL( 96, 0,			0 ),
+		PS2PP_MODEL( 97, PS2PP_KIND_TP3,	PS2PP_WHEEL | PS2PP_HWHEEL ),
+		PS2PP_MODEL( 99, PS2PP_KIND_WHEEL,	PS2PP_WHEEL ),
+		PS2PP_MODEL(100, PS2PP_KIND_MX,				/* MX510 */
 				PS2PP_WHEEL | PS2PP_SIDE_BTN | PS2PP_TASK_BTN |
-				PS2PP_EXTRA_BTN | PS2PP_NAV_BTN },
-		{ 111,  PS2PP_KIND_MX,	PS2PP_WHEEL | PS2PP_SIDE_BTN },	/* MX300 reports task button as side */
-		{ 112,	PS2PP_KIND_MX,					/* MX500 */
+				PS2PP_EXTRA_BTN | PS2PP_NAV_BTN ),
+		PS2PP_MODEL(111, PS2PP_KIND_MX,	PS2PP_WHEEL | PS2PP_SIDE_BTN ),	/* MX300 reports task button as side */
+		PS2PP_MODEL(112, PS2PP_KIND_MX,				/* MX500 */
 				PS2PP_WHEEL | PS2PP_SIDE_BTN | PS2PP_TASK_BTN |
-				PS2PP_EXTRA_BTN | PS2PP_NAV_BTN },
-		{ 114,	PS2PP_KIND_MX,					/* MX310 */
+				PS2PP_EXTRA_BTN | PS2PP_NAV_BTN ),
+		PS2PP_MODEL(114, PS2PP_KIND_MX,				/* MX310 */
 				PS2PP_WHEEL | PS2PP_SIDE_BTN |
-				PS2PP_TASK_BTN | PS2PP_EXTRA_BTN }
+				PS2PP_TASK_BTN | PS2PP_EXTRA_BTN ),
 	};
-	int i;
 
-	for (i = 0; i < ARRAY_SIZE(ps2pp_list); i++)
-		if (model == ps2pp_list[i].model)
-			return &ps2pp_list[i];
+#undef PS2PP_MODEL
 
-	return NULL;
+	if (model >= ARRAY_SIZE(ps2pp_list) || !ps2pp_list[model].model)
+		return NULL;
+
+	return &ps2pp_list[model];
 }
 
 /*
@@ -423,3 +431,23 @@ int ps2pp_init(struct psmouse *psmouse, bool set_properties)
 	return use_ps2pp ? 0 : -1;
 }
 
+#ifdef CONFIG_MOUSE_PS2_TEST
+/* Fixture for psmouse_test.ko; @model is the Logitech model number. */
+int ps2pp_test_init(struct psmouse *psmouse, unsigned int model)
+{
+	const struct ps2pp_info *model_info = get_model_info(model);
+
+	if (!model_info)
+		return -EINVAL;
+
+	psmouse->vendor = "Logitech";
+	psmouse->model = model;
+	psmouse->protocol_handler = ps2pp_process_byte;
+	psmouse->pktsize = 3;
+
+	__set_bit(BTN_MIDDLE, psmouse->dev->keybit);
+	ps2pp_set_model_properties(psmouse, model_info, true);
+
+	return 0;
+}
+#endif
@@ -20,4 +20,8 @@ inline int ps2pp_init(struct psmouse *psmouse, bool set_properties)
 }
 #endif /* CONFIG_MOUSE_PS2_LOGIPS2PP */
 
+#ifdef CONFIG_MOUSE_PS2_TEST
+int ps2pp_test_init(struct psmouse *psmouse, unsigned int model);
+#endif
+
 #endif
@@ -23,6 +23,7 @@
 #include <linux/init.h>
 #include <linux/libps2.h>
 #include <linux/mutex.h>
+#include <linux/ratelimit.h>
 
 #include "psmouse.h"
 #include "synaptics.h"
@@ -32,7 +33,6 @@
 #include "lifebook.h"
 #include "trackpoint.h"
 #include "touchkit_ps2.h"
-#include "byd.h"
 #include "elantech.h"
 #include "sentelic.h"
 #include "cypress_ps2.h"
@@ -91,6 +91,11 @@ PSMOUSE_DEFINE_ATTR(resetafter, S_IWUSR | S_IRUGO,
 PSMOUSE_DEFINE_ATTR(resync_time, S_IWUSR | S_IRUGO,
 			(void *) offsetof(struct psmouse, resync_time),
 			psmouse_show_int_attr, psmouse_set_int_attr);
+__PSMOUSE_DEFINE_ATTR(diag, S_IWUSR | S_IRUGO,
+			(void *) offsetof(struct psmouse, diag),
+			psmouse_show_int_attr, psmouse_attr_set_diag, false);
+PSMOUSE_DEFINE_RO_ATTR(diag_events, S_IRUGO, NULL,
+			psmouse_attr_show_diag_events);
 
 static struct attribute *psmouse_attributes[] = {
 	&psmouse_attr_protocol.dattr.attr,
@@ -98,6 +103,8 @@ static struct attribute *psmouse_attributes[] = {
 	&psmouse_attr_resolution.dattr.attr,
 	&psmouse_attr_resetafter.dattr.attr,
 	&psmouse_attr_resync_time.dattr.attr,
+	&psmouse_attr_diag.dattr.attr,
+	&psmouse_attr_diag_events.dattr.attr,
 	NULL
 };
 
@@ -114,17 +121,105 @@ static struct attribute_group psmouse_attribute_group = {
  */
 static DEFINE_MUTEX(psmouse_mutex);
 
+/*
+ * For protocol sysfs handlers that do not go through
+ * psmouse_attr_set_helper() but still need to be serialized against
+ * it and against connect, reconnect and disconnect.
+ */
+int psmouse_lock_interruptible(void)
+{
+	return mutex_lock_interruptible(&psmouse_mutex);
+}
+EXPORT_SYMBOL_GPL(psmouse_lock_interruptible);
+
+void psmouse_unlock(void)
+{
+	mutex_unlock(&psmouse_mutex);
+}
+EXPORT_SYMBOL_GPL(psmouse_unlock);
+
 static struct workqueue_struct *kpsmoused_wq;
 
-struct psmouse_protocol {
-	enum psmouse_type type;
-	bool maxproto;
-	bool ignore_parity; /* Protocol should ignore parity errors from KBC */
-	const char *name;
-	const char *alias;
-	int (*detect)(struct psmouse *, bool);
-	int (*init)(struct psmouse *);
+static struct serio_driver psmouse_drv;
+
+/*
+ * Protocols registered by other modules, indexed by type. Only types
+ * that are not built into psmouse_protocols[] can be registered.
+ */
+static const struct psmouse_protocol *psmouse_ext_protocols[PSMOUSE_AUTO];
+static DEFINE_MUTEX(psmouse_ext_mutex);
+
+/*
+ * Protocols that live in modules of their own. They are probed at their
+ * usual place in psmouse_extensions(), and their module is requested
+ * (once) the first time that place is reached.
+ */
+static const char * const psmouse_ext_aliases[PSMOUSE_AUTO] = {
+	[PSMOUSE_BYD]		= "byd",
 };
+static DECLARE_BITMAP(psmouse_ext_requested, PSMOUSE_AUTO);
+
+DEFINE_STATIC_KEY_FALSE(psmouse_diag_key);
+EXPORT_SYMBOL_GPL(psmouse_diag_key);
+
+/*
+ * Shared by all devices: a noisy controller should not be able to flood
+ * the log no matter how many ports it takes down with it.
+ */
+static DEFINE_RATELIMIT_STATE(psmouse_diag_ratelimit, 5 * HZ, 10);
+
+static const char * const psmouse_diag_names[PSMOUSE_DIAG_NR_EVENTS] = {
+	[PSMOUSE_DIAG_BAD_DATA]		= "bad_data",
+	[PSMOUSE_DIAG_UNEXPECTED]	= "unexpected",
+	[PSMOUSE_DIAG_DISCARDED]	= "discarded",
+	[PSMOUSE_DIAG_LOST_SYNC]	= "lost_sync",
+	[PSMOUSE_DIAG_KBC_ERROR]	= "kbc_error",
+	[PSMOUSE_DIAG_PACKET]		= "packets",
+};
+
+/*
+ * __psmouse_diag() accounts a diagnostic event and tells whether it
+ * should be logged. Only called through psmouse_diag(), i.e. while at
+ * least one device has diagnostics enabled.
+ */
+bool __psmouse_diag(struct psmouse *psmouse, enum psmouse_diag_event event)
+{
+	if (event == PSMOUSE_DIAG_PACKET) {
+		if (psmouse->diag < PSMOUSE_DIAG_TRACE)
+			return false;
+
+		/* Packet traces are asked for, do not drop any */
+		psmouse->diag_events[event]++;
+		return true;
+	}
+
+	if (psmouse->diag < PSMOUSE_DIAG_COUNT)
+		return false;
+
+	psmouse->diag_events[event]++;
+
+	return psmouse->diag >= PSMOUSE_DIAG_LOG &&
+		__ratelimit(&psmouse_diag_ratelimit);
+}
+EXPORT_SYMBOL_GPL(__psmouse_diag);
+
+/*
+ * psmouse_set_diag() changes the diagnostic level of a device, keeping
+ * psmouse_diag_key enabled for as long as any device needs it.
+ */
+void psmouse_set_diag(struct psmouse *psmouse, unsigned int level)
+{
+	if (level > PSMOUSE_DIAG_TRACE)
+		level = PSMOUSE_DIAG_TRACE;
+
+	if (!psmouse->diag && level)
+		static_branch_inc(&psmouse_diag_key);
+	else if (psmouse->diag && !level)
+		static_branch_dec(&psmouse_diag_key);
+
+	psmouse->diag = level;
+}
+EXPORT_SYMBOL_GPL(psmouse_set_diag);
 
 /*
  * psmouse_process_byte() analyzes the PS/2 data stream and reports
@@ -213,12 +308,14 @@ psmouse_ret_t psmouse_process_byte(struct psmouse *psmouse)
 
 	return PSMOUSE_FULL_PACKET;
 }
+EXPORT_SYMBOL_GPL(psmouse_process_byte);
 
 void psmouse_queue_work(struct psmouse *psmouse, struct delayed_work *work,
 		unsigned long delay)
 {
 	queue_delayed_work(kpsmoused_wq, work, delay);
 }
+EXPORT_SYMBOL_GPL(psmouse_queue_work);
 
 /*
  * __psmouse_set_state() sets new psmouse state and resets all flags.
@@ -245,6 +342,7 @@ void psmouse_set_state(struct psmouse *psmouse, enum psmouse_state new_state)
 	__psmouse_set_state(psmouse, new_state);
 	serio_continue_rx(psmouse->ps2dev.serio);
 }
+EXPORT_SYMBOL_GPL(psmouse_set_state);
 
 /*
  * psmouse_handle_byte() processes one byte of the input data stream
@@ -258,10 +356,11 @@ static int psmouse_handle_byte(struct psmouse *psmouse)
 	switch (rc) {
 	case PSMOUSE_BAD_DATA:
 		if (psmouse->state == PSMOUSE_ACTIVATED) {
-			psmouse_warn(psmouse,
-				     "%s at %s lost sync at byte %d\n",
+			psmouse_diag(psmouse, PSMOUSE_DIAG_LOST_SYNC,
+				     "%s at %s lost sync at byte %d: %*ph\n",
 				     psmouse->name, psmouse->phys,
-				     psmouse->pktcnt);
+				     psmouse->pktcnt,
+				     psmouse->pktcnt, psmouse->packet);
 			if (++psmouse->out_of_sync_cnt == psmouse->resetafter) {
 				__psmouse_set_state(psmouse, PSMOUSE_IGNORE);
 				psmouse_notice(psmouse,
@@ -274,6 +373,10 @@ static int psmouse_handle_byte(struct psmouse *psmouse)
 		break;
 
 	case PSMOUSE_FULL_PACKET:
+		if (!psmouse->diag_own_packets)
+			psmouse_diag(psmouse, PSMOUSE_DIAG_PACKET,
+				     "packet %*ph\n",
+				     psmouse->pktcnt, psmouse->packet);
 		psmouse->pktcnt = 0;
 		if (psmouse->out_of_sync_cnt) {
 			psmouse->out_of_sync_cnt = 0;
@@ -306,7 +409,7 @@ static irqreturn_t psmouse_interrupt(struct serio *serio,
 		     ((flags & SERIO_PARITY) && !psmouse->ignore_parity))) {
 
 		if (psmouse->state == PSMOUSE_ACTIVATED)
-			psmouse_warn(psmouse,
+			psmouse_diag(psmouse, PSMOUSE_DIAG_KBC_ERROR,
 				     "bad data from KBC -%s%s\n",
 				     flags & SERIO_TIMEOUT ? " timeout" : "",
 				     flags & SERIO_PARITY ? " bad parity" : "");
@@ -348,6 +451,7 @@ static irqreturn_t psmouse_interrupt(struct serio *serio,
 		if (psmouse->packet[1] == PSMOUSE_RET_ID ||
 		    (psmouse->type == PSMOUSE_HGPK &&
 		     psmouse->packet[1] == PSMOUSE_RET_BAT)) {
+			psmouse->bat_seen = true;
 			__psmouse_set_state(psmouse, PSMOUSE_IGNORE);
 			serio_reconnect(serio);
 			goto out;
@@ -381,6 +485,46 @@ static irqreturn_t psmouse_interrupt(struct serio *serio,
 	return IRQ_HANDLED;
 }
 
+/*
+ * psmouse_receive_packet() delivers a complete packet to the mouse bound
+ * to a pass-through port. Unlike feeding the packet byte by byte through
+ * serio_interrupt() it takes the port lock only once and skips the
+ * command/ACK, resync and new device checks of psmouse_interrupt(),
+ * none of which apply to an activated mouse sitting at a packet
+ * boundary. Returns false if the mouse is not in such a state, in which
+ * case the caller should fall back to serio_interrupt().
+ */
+bool psmouse_receive_packet(struct serio *serio,
+			    const unsigned char *packet, unsigned int len)
+{
+	struct psmouse *psmouse;
+	unsigned long flags;
+	bool handled = false;
+	unsigned int i;
+
+	spin_lock_irqsave(&serio->lock, flags);
+
+	psmouse = serio_get_drvdata(serio);
+	if (serio->drv != &psmouse_drv || !psmouse ||
+	    psmouse->state != PSMOUSE_ACTIVATED ||
+	    psmouse->pktcnt || psmouse->ps2dev.flags ||
+	    psmouse->pktsize != len || packet[0] == PSMOUSE_RET_BAT)
+		goto out;
+
+	psmouse->last = jiffies;
+
+	for (i = 0; i < len; i++) {
+		psmouse->packet[psmouse->pktcnt++] = packet[i];
+		if (psmouse_handle_byte(psmouse))
+			break;
+	}
+
+	handled = true;
+ out:
+	spin_unlock_irqrestore(&serio->lock, flags);
+	return handled;
+}
+
 
 /*
  * psmouse_sliced_command() sends an extended PS/2 command to the mouse
@@ -404,6 +548,7 @@ int psmouse_sliced_command(struct psmouse *psmouse, unsigned char command)
 
 	return 0;
 }
+EXPORT_SYMBOL_GPL(psmouse_sliced_command);
 
 
 /*
@@ -421,6 +566,7 @@ int psmouse_reset(struct psmouse *psmouse)
 
 	return 0;
 }
+EXPORT_SYMBOL_GPL(psmouse_reset);
 
 /*
  * Here we set the mouse resolution.
@@ -438,6 +584,7 @@ void psmouse_set_resolution(struct psmouse *psmouse, unsigned int resolution)
 	ps2_command(&psmouse->ps2dev, &p, PSMOUSE_CMD_SETRES);
 	psmouse->resolution = 25 << p;
 }
+EXPORT_SYMBOL_GPL(psmouse_set_resolution);
 
 /*
  * Here we set the mouse report rate.
@@ -516,6 +663,7 @@ bool psmouse_matches_pnp_id(struct psmouse *psmouse, const char * const ids[])
 	kfree(save_ptr);
 	return found;
 }
+EXPORT_SYMBOL_GPL(psmouse_matches_pnp_id);
 
 /*
  * Genius NetMouse magic init.
@@ -737,6 +885,7 @@ static void psmouse_apply_defaults(struct psmouse *psmouse)
 	psmouse->cleanup = NULL;
 	psmouse->pt_activate = NULL;
 	psmouse->pt_deactivate = NULL;
+	psmouse->diag_own_packets = false;
 }
 
 /*
@@ -753,6 +902,79 @@ static int psmouse_do_detect(int (*detect)(struct psmouse *psmouse,
 	return detect(psmouse, set_properties);
 }
 
+/*
+ * psmouse_get_ext_protocol() returns the protocol registered for @type
+ * with a reference to its module held, or NULL.
+ */
+static const struct psmouse_protocol *psmouse_get_ext_protocol(enum psmouse_type type)
+{
+	const struct psmouse_protocol *proto;
+
+	mutex_lock(&psmouse_ext_mutex);
+	proto = psmouse_ext_protocols[type];
+	if (proto && !try_module_get(proto->owner))
+		proto = NULL;
+	mutex_unlock(&psmouse_ext_mutex);
+
+	return proto;
+}
+
+/*
+ * psmouse_try_ext_protocol() probes a protocol registered by another
+ * module, loading that module first if it is one of
+ * psmouse_ext_aliases[]. Returns 0 if the protocol was detected (and,
+ * with @set_properties, initialized; the module reference is then kept
+ * in psmouse->protocol_owner), -ENODEV if it was not detected and
+ * -EIO if detection succeeded but initialization failed.
+ */
+static int psmouse_try_ext_protocol(struct psmouse *psmouse,
+				    enum psmouse_type type, bool set_properties)
+{
+	const struct psmouse_protocol *proto;
+	int error = 0;
+
+	proto = psmouse_get_ext_protocol(type);
+	if (!proto && psmouse_ext_aliases[type] &&
+	    !test_and_set_bit(type, psmouse_ext_requested)) {
+		request_module("psmouse-proto-%s", psmouse_ext_aliases[type]);
+		proto = psmouse_get_ext_protocol(type);
+	}
+
+	if (!proto)
+		return -ENODEV;
+
+	if (psmouse_do_detect(proto->detect, psmouse, set_properties))
+		error = -ENODEV;
+	else if (set_properties && proto->init && proto->init(psmouse))
+		error = -EIO;
+
+	if (!error && set_properties)
+		psmouse->protocol_owner = proto->owner;
+	else
+		module_put(proto->owner);
+
+	return error;
+}
+
+/*
+ * psmouse_ext_extensions() tries the remaining protocols registered by
+ * other modules, in type order.
+ */
+static int psmouse_ext_extensions(struct psmouse *psmouse, bool set_properties)
+{
+	int type;
+
+	for (type = PSMOUSE_NONE + 1; type < PSMOUSE_AUTO; type++) {
+		if (psmouse_ext_aliases[type])
+			continue;
+
+		if (psmouse_try_ext_protocol(psmouse, type, set_properties) == 0)
+			return type;
+	}
+
+	return PSMOUSE_NONE;
+}
+
 /*
  * psmouse_extensions() probes for any extensions to the basic PS/2 protocol
  * the mouse may have.
@@ -906,16 +1128,20 @@ static int psmouse_extensions(struct psmouse *psmouse,
 	}
 
 /*
- * Try BYD Touch Pad.
+ * Try BYD Touch Pad, provided by the psmouse-byd module.
  */
-	if (max_proto > PSMOUSE_IMEX &&
-	    psmouse_do_detect(byd_detect, psmouse, set_properties) == 0) {
-		if (!set_properties || byd_init(psmouse) == 0)
+	if (max_proto > PSMOUSE_IMEX) {
+		switch (psmouse_try_ext_protocol(psmouse, PSMOUSE_BYD,
+						 set_properties)) {
+		case 0:
 			return PSMOUSE_BYD;
+		case -EIO:
 /*
  * Init failed, try basic relative protocols
  */
-		max_proto = PSMOUSE_IMEX;
+			max_proto = PSMOUSE_IMEX;
+			break;
+		}
 	}
 
 	if (max_proto > PSMOUSE_IMEX) {
@@ -952,6 +1178,16 @@ static int psmouse_extensions(struct psmouse *psmouse,
 		}
 	}
 
+/*
+ * Try protocols registered by other modules.
+ */
+	if (max_proto > PSMOUSE_IMEX) {
+		int type = psmouse_ext_extensions(psmouse, set_properties);
+
+		if (type != PSMOUSE_NONE)
+			return type;
+	}
+
 /*
  * Reset to defaults in case the device got confused by extended
  * protocol probes. Note that we follow up with full reset because
@@ -1144,14 +1380,6 @@ static const struct psmouse_protocol psmouse_protocols[] = {
 		.init		= vmmouse_init,
 	},
 #endif
-#ifdef CONFIG_MOUSE_PS2_BYD
-	{
-		.type		= PSMOUSE_BYD,
-		.name		= "BYDPS/2",
-		.alias		= "byd",
-		.detect		= byd_detect,
-	},
-#endif
 
 	{
 		.type		= PSMOUSE_AUTO,
@@ -1161,7 +1389,7 @@ static const struct psmouse_protocol psmouse_protocols[] = {
 	},
 };
 
-static const struct psmouse_protocol *psmouse_protocol_by_type(enum psmouse_type type)
+static const struct psmouse_protocol *psmouse_builtin_protocol(enum psmouse_type type)
 {
 	int i;
 
@@ -1169,10 +1397,40 @@ static const struct psmouse_protocol *psmouse_protocol_by_type(enum psmouse_type
 		if (psmouse_protocols[i].type == type)
 			return &psmouse_protocols[i];
 
+	return NULL;
+}
+
+/*
+ * The lookups below return protocols with a reference to their module
+ * held, so that a registered protocol cannot go away while it is used.
+ * It is dropped with psmouse_put_protocol(); built-in protocols have no
+ * owner and are not counted.
+ */
+static const struct psmouse_protocol *psmouse_protocol_by_type(enum psmouse_type type)
+{
+	const struct psmouse_protocol *proto;
+
+	proto = psmouse_builtin_protocol(type);
+	if (proto)
+		return proto;
+
+	if (type < PSMOUSE_AUTO) {
+		proto = psmouse_get_ext_protocol(type);
+		if (proto)
+			return proto;
+	}
+
 	WARN_ON(1);
 	return &psmouse_protocols[0];
 }
 
+static bool psmouse_protocol_matches(const struct psmouse_protocol *p,
+				     const char *name, size_t len)
+{
+	return (strlen(p->name) == len && !strncmp(p->name, name, len)) ||
+	       (strlen(p->alias) == len && !strncmp(p->alias, name, len));
+}
+
 static const struct psmouse_protocol *psmouse_protocol_by_name(const char *name, size_t len)
 {
 	const struct psmouse_protocol *p;
@@ -1181,12 +1439,169 @@ static const struct psmouse_protocol *psmouse_protocol_by_name(const char *name,
 	for (i = 0; i < ARRAY_SIZE(psmouse_protocols); i++) {
 		p = &psmouse_protocols[i];
 
-		if ((strlen(p->name) == len && !strncmp(p->name, name, len)) ||
-		    (strlen(p->alias) == len && !strncmp(p->alias, name, len)))
+		if (psmouse_protocol_matches(p, name, len))
 			return &psmouse_protocols[i];
 	}
 
-	return NULL;
+	mutex_lock(&psmouse_ext_mutex);
+	for (i = 0; i < PSMOUSE_AUTO; i++) {
+		p = psmouse_ext_protocols[i];
+		if (p && psmouse_protocol_matches(p, name, len)) {
+			if (!try_module_get(p->owner))
+				p = NULL;
+			break;
+		}
+	}
+	mutex_unlock(&psmouse_ext_mutex);
+
+	return i < PSMOUSE_AUTO ? p : NULL;
+}
+
+static void psmouse_put_protocol(const struct psmouse_protocol *proto)
+{
+	module_put(proto->owner);
+}
+
+/**
+ * psmouse_register_protocol - make a protocol available to psmouse
+ * @proto: protocol description, must stay valid until unregistered
+ *
+ * Registers a protocol implemented outside of psmouse. @proto->type
+ * must be a type that psmouse was built without; the protocol takes
+ * part in autodetection after the built-in extended protocols and can
+ * be selected by name through the "protocol" attribute. Modules should
+ * also declare MODULE_ALIAS_PSMOUSE_PROTOCOL() with their alias so
+ * that selecting them by name loads them on demand.
+ */
+int psmouse_register_protocol(const struct psmouse_protocol *proto)
+{
+	int error = 0;
+
+	if (proto->type <= PSMOUSE_NONE || proto->type >= PSMOUSE_AUTO ||
+	    !proto->name || !proto->alias || !proto->detect)
+		return -EINVAL;
+
+	if (psmouse_builtin_protocol(proto->type))
+		return -EBUSY;
+
+	mutex_lock(&psmouse_ext_mutex);
+	if (psmouse_ext_protocols[proto->type])
+		error = -EBUSY;
+	else
+		psmouse_ext_protocols[proto->type] = proto;
+	mutex_unlock(&psmouse_ext_mutex);
+
+	return error;
+}
+EXPORT_SYMBOL_GPL(psmouse_register_protocol);
+
+/**
+ * psmouse_unregister_protocol - remove a protocol added by
+ *	psmouse_register_protocol()
+ * @proto: protocol to remove
+ *
+ * Devices hold a reference to the module of the protocol they use, so
+ * this is only called once no device uses @proto anymore.
+ */
+void psmouse_unregister_protocol(const struct psmouse_protocol *proto)
+{
+	mutex_lock(&psmouse_ext_mutex);
+	if (psmouse_ext_protocols[proto->type] == proto)
+		psmouse_ext_protocols[proto->type] = NULL;
+	mutex_unlock(&psmouse_ext_mutex);
+}
+EXPORT_SYMBOL_GPL(psmouse_unregister_protocol);
+
+#ifdef CONFIG_MOUSE_PS2_TEST
+/**
+ * psmouse_test_attach - set up a psmouse for replaying packets
+ * @psmouse: psmouse with ->dev allocated and ->ps2dev initialized
+ * @type: protocol to set up
+ * @model: protocol specific, see the *_test_init() fixtures
+ *
+ * For psmouse_test.ko only. Nothing is sent to the device. Returns
+ * -ENOSYS for protocols that are not built in or have no fixture.
+ */
+int psmouse_test_attach(struct psmouse *psmouse, enum psmouse_type type,
+			unsigned int model)
+{
+	struct input_dev *dev = psmouse->dev;
+
+	psmouse_apply_defaults(psmouse);
+	psmouse->type = type;
+
+	switch (type) {
+	case PSMOUSE_PS2:
+		return ps2bare_detect(psmouse, true);
+
+	case PSMOUSE_IMPS:
+		__set_bit(BTN_MIDDLE, dev->keybit);
+		__set_bit(REL_WHEEL, dev->relbit);
+		psmouse->pktsize = 4;
+		return 0;
+
+	case PSMOUSE_IMEX:
+		__set_bit(BTN_MIDDLE, dev->keybit);
+		__set_bit(REL_WHEEL, dev->relbit);
+		__set_bit(REL_HWHEEL, dev->relbit);
+		__set_bit(BTN_SIDE, dev->keybit);
+		__set_bit(BTN_EXTRA, dev->keybit);
+		psmouse->pktsize = 4;
+		return 0;
+
+	case PSMOUSE_PS2PP:
+		if (IS_ENABLED(CONFIG_MOUSE_PS2_LOGIPS2PP))
+			return ps2pp_test_init(psmouse, model);
+		break;
+
+	case PSMOUSE_SYNAPTICS:
+		if (IS_ENABLED(CONFIG_MOUSE_PS2_SYNAPTICS))
+			return synaptics_test_init(psmouse, model);
+		break;
+
+	case PSMOUSE_LIFEBOOK:
+		if (IS_ENABLED(CONFIG_MOUSE_PS2_LIFEBOOK))
+			return lifebook_test_init(psmouse, model);
+		break;
+
+	case PSMOUSE_FSP:
+		if (IS_ENABLED(CONFIG_MOUSE_PS2_SENTELIC))
+			return fsp_test_init(psmouse, model);
+		break;
+
+	case PSMOUSE_FOCALTECH:
+		if (IS_ENABLED(CONFIG_MOUSE_PS2_FOCALTECH))
+			return focaltech_test_init(psmouse, model);
+		break;
+
+	default:
+		break;
+	}
+
+	return -ENOSYS;
+}
+EXPORT_SYMBOL_GPL(psmouse_test_attach);
+
+/**
+ * psmouse_test_detach - tear down what psmouse_test_attach() set up
+ * @psmouse: psmouse to clean up
+ */
+void psmouse_test_detach(struct psmouse *psmouse)
+{
+	if (psmouse->disconnect)
+		psmouse->disconnect(psmouse);
+	else
+		kfree(psmouse->private);
+
+	psmouse->private = NULL;
+}
+EXPORT_SYMBOL_GPL(psmouse_test_detach);
+#endif
+
+static void psmouse_put_protocol_owner(struct psmouse *psmouse)
+{
+	module_put(psmouse->protocol_owner);
+	psmouse->protocol_owner = NULL;
 }
 
 
@@ -1257,6 +1672,7 @@ int psmouse_activate(struct psmouse *psmouse)
 	psmouse_set_state(psmouse, PSMOUSE_ACTIVATED);
 	return 0;
 }
+EXPORT_SYMBOL_GPL(psmouse_activate);
 
 /*
  * psmouse_deactivate() puts the mouse into poll mode so that we don't get motion
@@ -1274,6 +1690,7 @@ int psmouse_deactivate(struct psmouse *psmouse)
 	psmouse_set_state(psmouse, PSMOUSE_CMD_MODE);
 	return 0;
 }
+EXPORT_SYMBOL_GPL(psmouse_deactivate);
 
 
 /*
@@ -1450,11 +1867,13 @@ static void psmouse_disconnect(struct serio *serio)
 
 	if (psmouse->disconnect)
 		psmouse->disconnect(psmouse);
+	psmouse_put_protocol_owner(psmouse);
 
 	if (parent && parent->pt_deactivate)
 		parent->pt_deactivate(parent);
 
 	psmouse_set_state(psmouse, PSMOUSE_IGNORE);
+	psmouse_set_diag(psmouse, PSMOUSE_DIAG_OFF);
 
 	serio_close(serio);
 	serio_set_drvdata(serio, NULL);
@@ -1475,7 +1894,13 @@ static int psmouse_switch_protocol(struct psmouse *psmouse,
 
 	input_dev->dev.parent = &psmouse->ps2dev.serio->dev;
 
+	psmouse_put_protocol_owner(psmouse);
+
 	if (proto && (proto->detect || proto->init)) {
+		if (!try_module_get(proto->owner))
+			return -1;
+		psmouse->protocol_owner = proto->owner;
+
 		psmouse_apply_defaults(psmouse);
 
 		if (proto->detect && proto->detect(psmouse, true) < 0)
@@ -1485,15 +1910,15 @@ static int psmouse_switch_protocol(struct psmouse *psmouse,
 			return -1;
 
 		psmouse->type = proto->type;
-		selected_proto = proto;
+		psmouse->ignore_parity = proto->ignore_parity;
 	} else {
 		psmouse->type = psmouse_extensions(psmouse,
 						   psmouse_max_proto, true);
 		selected_proto = psmouse_protocol_by_type(psmouse->type);
+		psmouse->ignore_parity = selected_proto->ignore_parity;
+		psmouse_put_protocol(selected_proto);
 	}
 
-	psmouse->ignore_parity = selected_proto->ignore_parity;
-
 	/*
 	 * If mouse's packet size is 3 there is no point in polling the
 	 * device in hopes to detect protocol reset - we won't get less
@@ -1608,6 +2033,7 @@ static int psmouse_connect(struct serio *serio, struct serio_driver *drv)
  err_protocol_disconnect:
 	if (psmouse->disconnect)
 		psmouse->disconnect(psmouse);
+	psmouse_put_protocol_owner(psmouse);
 	psmouse_set_state(psmouse, PSMOUSE_IGNORE);
  err_close_serio:
 	serio_close(serio);
@@ -1667,6 +2093,8 @@ static int psmouse_reconnect(struct serio *serio)
 	rc = 0;
 
 out:
+	psmouse->bat_seen = false;
+
 	/* If this is a pass-through port the parent waits to be activated */
 	if (parent)
 		psmouse_activate(parent);
@@ -1717,6 +2145,7 @@ ssize_t psmouse_attr_show_helper(struct device *dev, struct device_attribute *de
 
 	return attr->show(psmouse, attr->data, buf);
 }
+EXPORT_SYMBOL_GPL(psmouse_attr_show_helper);
 
 ssize_t psmouse_attr_set_helper(struct device *dev, struct device_attribute *devattr,
 				const char *buf, size_t count)
@@ -1761,6 +2190,7 @@ ssize_t psmouse_attr_set_helper(struct device *dev, struct device_attribute *dev
  out:
 	return retval;
 }
+EXPORT_SYMBOL_GPL(psmouse_attr_set_helper);
 
 static ssize_t psmouse_show_int_attr(struct psmouse *psmouse, void *offset, char *buf)
 {
@@ -1786,7 +2216,13 @@ static ssize_t psmouse_set_int_attr(struct psmouse *psmouse, void *offset, const
 
 static ssize_t psmouse_attr_show_protocol(struct psmouse *psmouse, void *data, char *buf)
 {
-	return sprintf(buf, "%s\n", psmouse_protocol_by_type(psmouse->type)->name);
+	const struct psmouse_protocol *proto = psmouse_protocol_by_type(psmouse->type);
+	ssize_t len;
+
+	len = sprintf(buf, "%s\n", proto->name);
+	psmouse_put_protocol(proto);
+
+	return len;
 }
 
 static ssize_t psmouse_attr_set_protocol(struct psmouse *psmouse, void *data, const char *buf, size_t count)
@@ -1795,26 +2231,36 @@ static ssize_t psmouse_attr_set_protocol(struct psmouse *psmouse, void *data, co
 	struct psmouse *parent = NULL;
 	struct input_dev *old_dev, *new_dev;
 	const struct psmouse_protocol *proto, *old_proto;
+	ssize_t retval = count;
 	int error;
 	int retry = 0;
 
 	proto = psmouse_protocol_by_name(buf, count);
-	if (!proto)
-		return -EINVAL;
+	if (!proto) {
+		/* Protocols in separate modules are loaded on demand */
+		request_module("psmouse-proto-%.*s",
+			       (int)strcspn(buf, "\n"), buf);
+		proto = psmouse_protocol_by_name(buf, count);
+		if (!proto)
+			return -EINVAL;
+	}
 
 	if (psmouse->type == proto->type)
-		return count;
+		goto out;
 
 	new_dev = input_allocate_device();
-	if (!new_dev)
-		return -ENOMEM;
+	if (!new_dev) {
+		retval = -ENOMEM;
+		goto out;
+	}
 
 	while (!list_empty(&serio->children)) {
 		if (++retry > 3) {
 			psmouse_warn(psmouse,
 				     "failed to destroy children ports, protocol change aborted.\n");
 			input_free_device(new_dev);
-			return -EIO;
+			retval = -EIO;
+			goto out;
 		}
 
 		mutex_unlock(&psmouse_mutex);
@@ -1823,12 +2269,13 @@ static ssize_t psmouse_attr_set_protocol(struct psmouse *psmouse, void *data, co
 
 		if (serio->drv != &psmouse_drv) {
 			input_free_device(new_dev);
-			return -ENODEV;
+			retval = -ENODEV;
+			goto out;
 		}
 
 		if (psmouse->type == proto->type) {
 			input_free_device(new_dev);
-			return count; /* switched by other thread */
+			goto out; /* switched by other thread */
 		}
 	}
 
@@ -1839,6 +2286,7 @@ static ssize_t psmouse_attr_set_protocol(struct psmouse *psmouse, void *data, co
 	}
 
 	old_dev = psmouse->dev;
+	/* Referenced, it may be needed again if the new device fails */
 	old_proto = psmouse_protocol_by_type(psmouse->type);
 
 	if (psmouse->disconnect)
@@ -1871,15 +2319,20 @@ static ssize_t psmouse_attr_set_protocol(struct psmouse *psmouse, void *data, co
 		psmouse_initialize(psmouse);
 		psmouse_set_state(psmouse, PSMOUSE_CMD_MODE);
 
-		return error;
+		psmouse_put_protocol(old_proto);
+		retval = error;
+		goto out;
 	}
 
 	input_unregister_device(old_dev);
+	psmouse_put_protocol(old_proto);
 
 	if (parent && parent->pt_activate)
 		parent->pt_activate(parent);
 
-	return count;
+out:
+	psmouse_put_protocol(proto);
+	return retval;
 }
 
 static ssize_t psmouse_attr_set_rate(struct psmouse *psmouse, void *data, const char *buf, size_t count)
@@ -1908,6 +2361,33 @@ static ssize_t psmouse_attr_set_resolution(struct psmouse *psmouse, void *data,
 	return count;
 }
 
+static ssize_t psmouse_attr_set_diag(struct psmouse *psmouse, void *data, const char *buf, size_t count)
+{
+	unsigned int value;
+	int err;
+
+	err = kstrtouint(buf, 10, &value);
+	if (err)
+		return err;
+
+	if (value > PSMOUSE_DIAG_TRACE)
+		return -EINVAL;
+
+	psmouse_set_diag(psmouse, value);
+	return count;
+}
+
+static ssize_t psmouse_attr_show_diag_events(struct psmouse *psmouse, void *data, char *buf)
+{
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < PSMOUSE_DIAG_NR_EVENTS; i++)
+		len += sprintf(buf + len, "%s %lu\n",
+			       psmouse_diag_names[i], psmouse->diag_events[i]);
+
+	return len;
+}
 
 static int psmouse_set_maxproto(const char *val, const struct kernel_param *kp)
 {
@@ -1917,11 +2397,16 @@ static int psmouse_set_maxproto(const char *val, const struct kernel_param *kp)
 		return -EINVAL;
 
 	proto = psmouse_protocol_by_name(val, strlen(val));
+	if (!proto)
+		return -EINVAL;
 
-	if (!proto || !proto->maxproto)
+	if (!proto->maxproto) {
+		psmouse_put_protocol(proto);
 		return -EINVAL;
+	}
 
 	*((unsigned int *)kp->arg) = proto->type;
+	psmouse_put_protocol(proto);
 
 	return 0;
 }
@@ -1929,14 +2414,26 @@ static int psmouse_set_maxproto(const char *val, const struct kernel_param *kp)
 static int psmouse_get_maxproto(char *buffer, const struct kernel_param *kp)
 {
 	int type = *((unsigned int *)kp->arg);
+	const struct psmouse_protocol *proto = psmouse_protocol_by_type(type);
+	int len;
+
+	len = sprintf(buffer, "%s", proto->name);
+	psmouse_put_protocol(proto);
 
-	return sprintf(buffer, "%s", psmouse_protocol_by_type(type)->name);
+	return len;
 }
 
 static int __init psmouse_init(void)
 {
 	int err;
 
+	/*
+	 * Per-byte state must fit in 64 bytes; ps2dev.flags is read per
+	 * byte too but lives outside it, see struct psmouse.
+	 */
+	BUILD_BUG_ON(offsetof(struct psmouse, out_of_sync_cnt) +
+		     sizeof(unsigned long) > 64);
+
 	lifebook_module_init();
 	synaptics_module_init();
 	hgpk_module_init();
@@ -1948,14 +2445,19 @@ static int __init psmouse_init(void)
 	}
 
 	err = serio_register_driver(&psmouse_drv);
-	if (err)
+	if (err) {
 		destroy_workqueue(kpsmoused_wq);
+		return err;
+	}
+
+	vmmouse_sim_module_init();
 
-	return err;
+	return 0;
 }
 
 static void __exit psmouse_exit(void)
 {
+	vmmouse_sim_module_exit();
 	serio_unregister_driver(&psmouse_drv);
 	destroy_workqueue(kpsmoused_wq);
 }
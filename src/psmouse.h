@@ -1,6 +1,8 @@
 #ifndef _PSMOUSE_H
 #define _PSMOUSE_H
 
+#include <linux/jump_label.h>
+
 #define PSMOUSE_CMD_SETSCALE11	0x00e6
 #define PSMOUSE_CMD_SETSCALE21	0x00e7
 #define PSMOUSE_CMD_SETRES	0x10e8
@@ -36,40 +38,71 @@ typedef enum {
 	PSMOUSE_FULL_PACKET
 } psmouse_ret_t;
 
+/*
+ * Events reported by the protocol handlers through psmouse_diag()
+ */
+enum psmouse_diag_event {
+	PSMOUSE_DIAG_BAD_DATA,		/* packet failed validation */
+	PSMOUSE_DIAG_UNEXPECTED,	/* valid but unexpected packet */
+	PSMOUSE_DIAG_DISCARDED,		/* packet dropped by a quirk */
+	PSMOUSE_DIAG_LOST_SYNC,		/* handler rejected a byte */
+	PSMOUSE_DIAG_KBC_ERROR,		/* parity/timeout from the KBC */
+	PSMOUSE_DIAG_PACKET,		/* every complete packet */
+	PSMOUSE_DIAG_NR_EVENTS
+};
+
+/* Diagnostic levels, per device */
+#define PSMOUSE_DIAG_OFF	0
+#define PSMOUSE_DIAG_COUNT	1	/* count events */
+#define PSMOUSE_DIAG_LOG	2	/* ... and log them, rate limited */
+#define PSMOUSE_DIAG_TRACE	3	/* ... and dump every packet */
+
 enum psmouse_scale {
 	PSMOUSE_SCALE11,
 	PSMOUSE_SCALE21
 };
 
+/*
+ * The fields up to and including out_of_sync_cnt are used by
+ * psmouse_interrupt() and the protocol handlers for every received
+ * byte; they are kept together at the start so that they fit in 64
+ * bytes (checked in psmouse_init()).  This only gives a single line if
+ * the structure itself is cacheline aligned, which kmalloc does for an
+ * object of this size but does not promise.
+ *
+ * psmouse_interrupt() also tests ps2dev.flags for every byte to catch
+ * command ACKs and responses.  That word belongs to libps2 and sits
+ * behind the serio pointer, mutex and wait queue in struct ps2dev, so
+ * it is on a second line even though ps2dev follows the block.
+ */
 struct psmouse {
+	psmouse_ret_t (*protocol_handler)(struct psmouse *psmouse);
 	void *private;
 	struct input_dev *dev;
-	struct ps2dev ps2dev;
-	struct delayed_work resync_work;
-	char *vendor;
-	char *name;
+	unsigned long last;
+	enum psmouse_state state;
+	unsigned int resync_time;
 	unsigned char packet[8];
-	unsigned char badbyte;
 	unsigned char pktcnt;
 	unsigned char pktsize;
 	unsigned char type;
+	unsigned char badbyte;
 	bool ignore_parity;
 	bool acks_disable_command;
-	unsigned int model;
-	unsigned long last;
+	bool bat_seen;		/* device announced itself since last reconnect */
 	unsigned long out_of_sync_cnt;
+
+	struct ps2dev ps2dev;
+	unsigned int resetafter;
+	unsigned int model;
 	unsigned long num_resyncs;
-	enum psmouse_state state;
-	char devname[64];
-	char phys[32];
+	char *vendor;
+	char *name;
 
 	unsigned int rate;
 	unsigned int resolution;
-	unsigned int resetafter;
-	unsigned int resync_time;
 	bool smartscroll;	/* Logitech only */
 
-	psmouse_ret_t (*protocol_handler)(struct psmouse *psmouse);
 	void (*set_rate)(struct psmouse *psmouse, unsigned int rate);
 	void (*set_resolution)(struct psmouse *psmouse, unsigned int resolution);
 	void (*set_scale)(struct psmouse *psmouse, enum psmouse_scale scale);
@@ -81,6 +114,15 @@ struct psmouse {
 
 	void (*pt_activate)(struct psmouse *psmouse);
 	void (*pt_deactivate)(struct psmouse *psmouse);
+
+	struct module *protocol_owner;	/* module of a registered protocol */
+	unsigned int diag;	/* PSMOUSE_DIAG_* level */
+	bool diag_own_packets;	/* protocol decodes its own packet traces */
+	unsigned long diag_events[PSMOUSE_DIAG_NR_EVENTS];
+
+	struct delayed_work resync_work;
+	char devname[64];
+	char phys[32];
 };
 
 enum psmouse_type {
@@ -108,6 +150,35 @@ enum psmouse_type {
 	PSMOUSE_AUTO		/* This one should always be last */
 };
 
+struct psmouse_protocol {
+	enum psmouse_type type;
+	bool maxproto;
+	bool ignore_parity; /* Protocol should ignore parity errors from KBC */
+	const char *name;
+	const char *alias;
+	int (*detect)(struct psmouse *, bool);
+	int (*init)(struct psmouse *);
+	struct module *owner;	/* registered protocols only */
+};
+
+int psmouse_register_protocol(const struct psmouse_protocol *proto);
+void psmouse_unregister_protocol(const struct psmouse_protocol *proto);
+
+/* Lets request_module() find the module providing protocol _alias */
+#define MODULE_ALIAS_PSMOUSE_PROTOCOL(_alias)	\
+	MODULE_ALIAS("psmouse-proto-" _alias)
+
+#ifdef CONFIG_MOUSE_PS2_TEST
+/*
+ * Fixtures for psmouse_test.ko: set a psmouse up for a protocol the way
+ * its init routine would, but without talking to the device, so that
+ * canned packets can be fed to the protocol handler.
+ */
+int psmouse_test_attach(struct psmouse *psmouse, enum psmouse_type type,
+			unsigned int model);
+void psmouse_test_detach(struct psmouse *psmouse);
+#endif
+
 void psmouse_queue_work(struct psmouse *psmouse, struct delayed_work *work,
 		unsigned long delay);
 int psmouse_sliced_command(struct psmouse *psmouse, unsigned char command);
@@ -115,6 +186,10 @@ int psmouse_reset(struct psmouse *psmouse);
 void psmouse_set_state(struct psmouse *psmouse, enum psmouse_state new_state);
 void psmouse_set_resolution(struct psmouse *psmouse, unsigned int resolution);
 psmouse_ret_t psmouse_process_byte(struct psmouse *psmouse);
+bool psmouse_receive_packet(struct serio *serio,
+			    const unsigned char *packet, unsigned int len);
+int psmouse_lock_interruptible(void);
+void psmouse_unlock(void);
 int psmouse_activate(struct psmouse *psmouse);
 int psmouse_deactivate(struct psmouse *psmouse);
 bool psmouse_matches_pnp_id(struct psmouse *psmouse, const char * const ids[]);
@@ -190,5 +265,27 @@ static struct psmouse_attribute psmouse_attr_##_name = {			\
 		   &(psmouse)->ps2dev.serio->dev,	\
 		   psmouse_fmt(format), ##__VA_ARGS__)
 
+/*
+ * Packet diagnostics. The static key is only enabled while at least
+ * one device has a diagnostic level set, so that the receive path pays
+ * for a single patched-out branch otherwise.
+ */
+DECLARE_STATIC_KEY_FALSE(psmouse_diag_key);
+
+bool __psmouse_diag(struct psmouse *psmouse, enum psmouse_diag_event event);
+void psmouse_set_diag(struct psmouse *psmouse, unsigned int level);
+
+/* Accounts @event and tells whether the caller should log it */
+#define psmouse_diag_event(psmouse, event)			\
+	(static_branch_unlikely(&psmouse_diag_key) &&		\
+	 __psmouse_diag(psmouse, event))
+
+#define psmouse_diag(psmouse, event, format, ...)		\
+do {								\
+	if (psmouse_diag_event(psmouse, event))			\
+		psmouse_printk(KERN_DEBUG, psmouse,		\
+			       format, ##__VA_ARGS__);		\
+} while (0)
+
 
 #endif /* _PSMOUSE_H */
@@ -0,0 +1,651 @@
+/*
+ * Replay tests and packet timing for the psmouse protocol handlers.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * On load, every test case sets up a psmouse for its protocol through
+ * psmouse_test_attach(), registers its input device and feeds a canned
+ * byte stream to the protocol handler the way psmouse_handle_byte()
+ * does.  An input handler bound to the test devices records the events
+ * they emit, which are compared with the expected ones.  The stream is
+ * then replayed "iterations" times and the time per packet, including
+ * delivery through the input core, is logged.  Loading fails if any
+ * case fails.
+ *
+ * The test devices are ordinary input devices while the tests run, so
+ * load this on a test machine: the desktop sees them as well.
+ *
+ * Build with "make ... CONFIG_MOUSE_PS2_TEST=y", which also adds the
+ * fixtures to psmouse.ko.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/input.h>
+#include <linux/serio.h>
+#include <linux/libps2.h>
+
+#include "psmouse.h"
+
+MODULE_AUTHOR("psmouse maintainers");
+MODULE_DESCRIPTION("PS/2 mouse protocol handler replay tests");
+MODULE_LICENSE("GPL");
+
+static unsigned int iterations = 1000;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations,
+		 "Times each stream is replayed for timing, 0 to skip.");
+
+#define PSMOUSE_TEST_MAX_EVENTS		64
+
+/* @dev is 0 for the psmouse input device, 1 for a second one */
+struct psmouse_test_event {
+	u8 dev;
+	u16 type;
+	u16 code;
+	s32 value;
+};
+
+#define EV(_dev, _type, _code, _value)					\
+	{ .dev = (_dev), .type = EV_##_type, .code = (_code), .value = (_value) }
+#define SYN(_dev)	EV(_dev, SYN, SYN_REPORT, 0)
+
+struct psmouse_test_case {
+	const char *name;
+	enum psmouse_type type;
+	unsigned int model;		/* see psmouse_test_attach() */
+
+	const unsigned char *data;
+	unsigned int len;
+	unsigned int packets;		/* complete packets in data */
+	unsigned int bad;		/* bytes rejected by the handler */
+
+	const struct psmouse_test_event *events;
+	unsigned int num_events;
+	bool partial;			/* other events may come in between */
+
+	int (*check)(struct psmouse *psmouse);
+};
+
+#define PSMOUSE_TEST_STREAM(_data, _events)				\
+	.data = _data, .len = sizeof(_data),				\
+	.events = _events, .num_events = ARRAY_SIZE(_events)
+
+static struct serio *psmouse_test_serio;
+
+/* Only touched from the input core while a test feeds bytes */
+static struct {
+	struct input_dev *dev;
+	bool enabled;
+	unsigned int count;
+	struct psmouse_test_event events[PSMOUSE_TEST_MAX_EVENTS];
+} psmouse_test_log;
+
+static void psmouse_test_input_event(struct input_handle *handle,
+				     unsigned int type, unsigned int code,
+				     int value)
+{
+	struct psmouse_test_event *ev;
+
+	if (!psmouse_test_log.enabled)
+		return;
+
+	if (psmouse_test_log.count < PSMOUSE_TEST_MAX_EVENTS) {
+		ev = &psmouse_test_log.events[psmouse_test_log.count];
+		ev->dev = handle->dev != psmouse_test_log.dev;
+		ev->type = type;
+		ev->code = code;
+		ev->value = value;
+	}
+
+	psmouse_test_log.count++;
+}
+
+static bool psmouse_test_match(struct input_handler *handler,
+			       struct input_dev *dev)
+{
+	return dev->dev.parent == &psmouse_test_serio->dev;
+}
+
+static int psmouse_test_connect(struct input_handler *handler,
+				struct input_dev *dev,
+				const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "psmouse_test";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_free;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_unregister;
+
+	return 0;
+
+ err_unregister:
+	input_unregister_handle(handle);
+ err_free:
+	kfree(handle);
+	return error;
+}
+
+static void psmouse_test_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id psmouse_test_ids[] = {
+	{ .driver_info = 1 },	/* all devices, narrowed down by match() */
+	{ },
+};
+
+static struct input_handler psmouse_test_handler = {
+	.event		= psmouse_test_input_event,
+	.match		= psmouse_test_match,
+	.connect	= psmouse_test_connect,
+	.disconnect	= psmouse_test_disconnect,
+	.name		= "psmouse_test",
+	.id_table	= psmouse_test_ids,
+};
+
+/*
+ * The bookkeeping psmouse_handle_byte() does around the protocol
+ * handler, minus the resync and reconnect handling.
+ */
+static void psmouse_test_feed(struct psmouse *psmouse,
+			      const unsigned char *data, unsigned int len,
+			      unsigned int *packets, unsigned int *bad)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		psmouse->packet[psmouse->pktcnt++] = data[i];
+
+		switch (psmouse->protocol_handler(psmouse)) {
+		case PSMOUSE_BAD_DATA:
+			(*bad)++;
+			psmouse->pktcnt = 0;
+			break;
+
+		case PSMOUSE_FULL_PACKET:
+			(*packets)++;
+			psmouse->pktcnt = 0;
+			break;
+
+		case PSMOUSE_GOOD_DATA:
+			break;
+		}
+	}
+}
+
+static bool psmouse_test_events_match(const struct psmouse_test_case *tc)
+{
+	const struct psmouse_test_event *want, *got;
+	unsigned int i, n = 0;
+
+	if (psmouse_test_log.count > PSMOUSE_TEST_MAX_EVENTS)
+		return false;
+
+	for (i = 0; i < psmouse_test_log.count && n < tc->num_events; i++) {
+		want = &tc->events[n];
+		got = &psmouse_test_log.events[i];
+
+		if (got->dev == want->dev && got->type == want->type &&
+		    got->code == want->code && got->value == want->value)
+			n++;
+		else if (!tc->partial)
+			return false;
+	}
+
+	return n == tc->num_events &&
+		(tc->partial || psmouse_test_log.count == tc->num_events);
+}
+
+static void psmouse_test_dump_events(const struct psmouse_test_case *tc)
+{
+	const struct psmouse_test_event *ev;
+	unsigned int i;
+
+	for (i = 0; i < min_t(unsigned int, psmouse_test_log.count,
+			      PSMOUSE_TEST_MAX_EVENTS); i++) {
+		ev = &psmouse_test_log.events[i];
+		pr_info("%s: event %u: dev %u type %u code %u value %d\n",
+			tc->name, i, ev->dev, ev->type, ev->code, ev->value);
+	}
+}
+
+static int psmouse_test_run(const struct psmouse_test_case *tc)
+{
+	struct psmouse *psmouse;
+	struct input_dev *dev;
+	unsigned int packets = 0, bad = 0;
+	unsigned int i;
+	ktime_t start;
+	u64 ns;
+	int error;
+
+	psmouse = kzalloc(sizeof(struct psmouse), GFP_KERNEL);
+	dev = input_allocate_device();
+	if (!psmouse || !dev) {
+		error = -ENOMEM;
+		goto err_free;
+	}
+
+	psmouse->dev = dev;
+	ps2_init(&psmouse->ps2dev, psmouse_test_serio);
+
+	dev->name = tc->name;
+	dev->phys = psmouse_test_serio->phys;
+	dev->id.bustype = BUS_VIRTUAL;
+	dev->id.vendor = 0x0002;
+	dev->id.product = tc->type;
+	dev->dev.parent = &psmouse_test_serio->dev;
+
+	error = psmouse_test_attach(psmouse, tc->type, tc->model);
+	if (error)
+		goto err_detach;
+
+	error = input_register_device(dev);
+	if (error)
+		goto err_detach;
+
+	psmouse_test_log.dev = dev;
+	psmouse_test_log.count = 0;
+	psmouse_test_log.enabled = true;
+	psmouse_test_feed(psmouse, tc->data, tc->len, &packets, &bad);
+	psmouse_test_log.enabled = false;
+
+	if (packets != tc->packets || bad != tc->bad ||
+	    !psmouse_test_events_match(tc)) {
+		pr_err("%s: FAIL: %u packets, %u bad bytes, %u events, expected %u, %u, %u\n",
+		       tc->name, packets, bad, psmouse_test_log.count,
+		       tc->packets, tc->bad, tc->num_events);
+		psmouse_test_dump_events(tc);
+		error = -EINVAL;
+	} else if (tc->check) {
+		error = tc->check(psmouse);
+	}
+
+	if (!error && iterations) {
+		packets = 0;
+		start = ktime_get();
+		for (i = 0; i < iterations; i++)
+			psmouse_test_feed(psmouse, tc->data, tc->len,
+					  &packets, &bad);
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		pr_info("%s: ok, %llu ns/packet over %u packets\n",
+			tc->name, packets ? div_u64(ns, packets) : 0ULL,
+			packets);
+	} else if (!error) {
+		pr_info("%s: ok\n", tc->name);
+	}
+
+	psmouse_test_detach(psmouse);
+	input_unregister_device(dev);
+	kfree(psmouse);
+	return error;
+
+ err_detach:
+	psmouse_test_detach(psmouse);
+ err_free:
+	input_free_device(dev);
+	kfree(psmouse);
+	return error;
+}
+
+/*
+ * The 6-byte Lifebook checks as lifebook_process_byte() made them
+ * before they were turned into a table.
+ */
+static bool psmouse_test_lifebook_ref(const unsigned char *packet, int pktcnt)
+{
+	if (packet[0] & 0x08)		/* relative packets are not checked */
+		return true;
+
+	switch (pktcnt) {
+	case 1:
+		return (packet[0] & 0xf8) == 0x00;
+	case 3:
+		return ((packet[2] & 0x30) << 2) == (packet[2] & 0xc0);
+	case 4:
+		return (packet[3] & 0xf8) == 0xc0;
+	case 5:
+		return (packet[4] & 0xc0) == (packet[2] & 0xc0);
+	case 6:
+		return ((packet[5] & 0x30) << 2) == (packet[5] & 0xc0) &&
+			(packet[5] & 0xc0) == (packet[1] & 0xc0);
+	default:
+		return true;
+	}
+}
+
+/*
+ * Every value of each byte, with the other bytes set to every value as
+ * well (byte 0 is kept at 0 for the later bytes, to stay on the 6-byte
+ * path), must be accepted or rejected by the handler as the reference
+ * does: 256 + 5 * 65536 cases.
+ */
+static int psmouse_test_lifebook_check(struct psmouse *psmouse)
+{
+	unsigned char *packet = psmouse->packet;
+	unsigned int pos, other, b;
+	unsigned int cases = 0, errors = 0;
+	bool accepted, expected;
+
+	for (pos = 0; pos < 6; pos++) {
+		for (other = 0; other < (pos ? 256 : 1); other++) {
+			for (b = 0; b < 256; b++) {
+				memset(packet, other, 6);
+				packet[0] = 0;
+				packet[pos] = b;
+				psmouse->pktcnt = pos + 1;
+
+				accepted = psmouse->protocol_handler(psmouse) !=
+						PSMOUSE_BAD_DATA;
+				expected = psmouse_test_lifebook_ref(packet,
+								     pos + 1);
+				if (accepted != expected && errors++ < 8)
+					pr_err("lifebook: byte %u = %02x, others %02x: %s, expected %s\n",
+					       pos, b, other,
+					       accepted ? "accepted" : "rejected",
+					       expected ? "accepted" : "rejected");
+				cases++;
+			}
+		}
+	}
+
+	psmouse->pktcnt = 0;
+
+	if (errors) {
+		pr_err("lifebook: FAIL: %u of %u validation cases differ\n",
+		       errors, cases);
+		return -EINVAL;
+	}
+
+	pr_info("lifebook: %u validation cases match\n", cases);
+	return 0;
+}
+
+static const unsigned char ps2_data[] = {
+	0x09, 0x05, 0x02,
+	0x3a, 0xff, 0x10,
+};
+
+static const struct psmouse_test_event ps2_events[] = {
+	EV(0, KEY, BTN_LEFT, 1), EV(0, REL, REL_X, 5), EV(0, REL, REL_Y, -2),
+	SYN(0),
+	EV(0, KEY, BTN_LEFT, 0), EV(0, KEY, BTN_RIGHT, 1),
+	EV(0, REL, REL_X, -1), EV(0, REL, REL_Y, 240),
+	SYN(0),
+};
+
+static const unsigned char imps_data[] = {
+	0x08, 0x00, 0x00, 0xff,
+	0x08, 0x00, 0x00, 0x02,
+};
+
+static const struct psmouse_test_event imps_events[] = {
+	EV(0, REL, REL_WHEEL, 1), SYN(0),
+	EV(0, REL, REL_WHEEL, -2), SYN(0),
+};
+
+static const unsigned char imex_data[] = {
+	0x08, 0x00, 0x00, 0x01,		/* wheel */
+	0x08, 0x00, 0x00, 0x41,		/* horizontal wheel */
+	0x08, 0x00, 0x00, 0x10,		/* side button */
+};
+
+static const struct psmouse_test_event imex_events[] = {
+	EV(0, REL, REL_WHEEL, -1), SYN(0),
+	EV(0, REL, REL_HWHEEL, -1), SYN(0),
+	EV(0, KEY, BTN_SIDE, 1), SYN(0),
+};
+
+static const unsigned char ps2pp_data[] = {
+	0x09, 0x05, 0x02,		/* plain motion */
+	0x48, 0xd2, 0x11,		/* mouse extra info */
+	0x48, 0xe2, 0x08,		/* buttons 4-10 */
+};
+
+static const struct psmouse_test_event ps2pp_events[] = {
+	EV(0, REL, REL_X, 5), EV(0, REL, REL_Y, -2), EV(0, KEY, BTN_LEFT, 1),
+	SYN(0),
+	EV(0, REL, REL_WHEEL, -1), EV(0, KEY, BTN_SIDE, 1),
+	EV(0, KEY, BTN_LEFT, 0),
+	SYN(0),
+	EV(0, KEY, BTN_SIDE, 0), EV(0, KEY, BTN_BACK, 1),
+	SYN(0),
+};
+
+static const unsigned char synaptics_data[] = {
+	0x00,					/* bad first byte */
+	0x90, 0x7b, 0x3c, 0xc0, 0xb8, 0xd0,	/* finger down */
+	0x80, 0x00, 0x00, 0xc0, 0x00, 0x00,	/* finger up */
+};
+
+static const struct psmouse_test_event synaptics_events[] = {
+	EV(0, KEY, BTN_TOUCH, 1),
+	EV(0, ABS, ABS_X, 3000), EV(0, ABS, ABS_Y, 3856),
+	EV(0, ABS, ABS_PRESSURE, 60),
+	EV(0, KEY, BTN_TOOL_FINGER, 1),
+	SYN(0),
+	EV(0, KEY, BTN_TOUCH, 0), EV(0, ABS, ABS_PRESSURE, 0),
+	EV(0, KEY, BTN_TOOL_FINGER, 0),
+	SYN(0),
+};
+
+/*
+ * The second absolute packet only changes buttons and the relative one
+ * goes to the second device; idle absolute packets must not reach it.
+ */
+static const unsigned char lifebook_data[] = {
+	0x04, 0x10, 0x05, 0xc0, 0x20, 0x0a,	/* touch */
+	0x05, 0x10, 0x05, 0xc0, 0x20, 0x0a,	/* left button */
+	0x09, 0x03, 0x02,			/* relative motion */
+	0x40,					/* bad first byte */
+	0x00, 0x10, 0x05, 0xc0, 0x20, 0x0a,	/* release */
+};
+
+static const struct psmouse_test_event lifebook_events[] = {
+	EV(0, ABS, ABS_X, 1029), EV(0, ABS, ABS_Y, 2038),
+	EV(0, KEY, BTN_TOUCH, 1),
+	SYN(0),
+	EV(1, KEY, BTN_LEFT, 1), SYN(1),
+	EV(1, REL, REL_X, 3), EV(1, REL, REL_Y, -2), SYN(1),
+	EV(0, KEY, BTN_TOUCH, 0), SYN(0),
+	EV(1, KEY, BTN_LEFT, 0), SYN(1),
+};
+
+static const unsigned char fsp_data[] = {
+	0x09, 0x05, 0x02, 0x00,		/* motion with left button */
+	0x08, 0x00, 0x00, 0x01,		/* on-pad wheel down */
+};
+
+static const struct psmouse_test_event fsp_events[] = {
+	EV(0, KEY, BTN_LEFT, 1), EV(0, REL, REL_X, 5), EV(0, REL, REL_Y, -2),
+	SYN(0),
+	EV(0, REL, REL_WHEEL, -1), EV(0, KEY, BTN_LEFT, 0),
+	SYN(0),
+};
+
+/*
+ * Slot bookkeeping of the MT core is left out; only the contact itself
+ * and the pointer emulation are checked.
+ */
+static const unsigned char focaltech_data[] = {
+	0x03, 0x01, 0x00, 0x00, 0x00, 0x00,	/* finger 1 touching */
+	0x06, 0x11, 0x23, 0x02, 0x00, 0x30,	/* finger 1 at 291,512 */
+	0x19, 0x05, 0xfe, 0x00, 0x00, 0x00,	/* moved by 5,-2 */
+	0x03, 0x00, 0x00, 0x00, 0x00, 0x00,	/* released */
+};
+
+static const struct psmouse_test_event focaltech_events[] = {
+	EV(0, ABS, ABS_MT_POSITION_X, 291), EV(0, ABS, ABS_MT_POSITION_Y, 1024),
+	EV(0, ABS, ABS_TOOL_WIDTH, 3),
+	EV(0, KEY, BTN_TOUCH, 1), EV(0, KEY, BTN_TOOL_FINGER, 1),
+	EV(0, ABS, ABS_X, 291), EV(0, ABS, ABS_Y, 1024),
+	SYN(0),
+	EV(0, ABS, ABS_MT_POSITION_X, 296), EV(0, ABS, ABS_MT_POSITION_Y, 1026),
+	EV(0, ABS, ABS_X, 296), EV(0, ABS, ABS_Y, 1026),
+	SYN(0),
+	EV(0, ABS, ABS_MT_TRACKING_ID, -1),
+	EV(0, KEY, BTN_TOUCH, 0), EV(0, KEY, BTN_TOOL_FINGER, 0),
+	SYN(0),
+};
+
+static const struct psmouse_test_case psmouse_test_cases[] = {
+	{
+		.name		= "PS/2",
+		.type		= PSMOUSE_PS2,
+		PSMOUSE_TEST_STREAM(ps2_data, ps2_events),
+		.packets	= 2,
+	},
+	{
+		.name		= "ImPS/2",
+		.type		= PSMOUSE_IMPS,
+		PSMOUSE_TEST_STREAM(imps_data, imps_events),
+		.packets	= 2,
+	},
+	{
+		.name		= "ImExPS/2",
+		.type		= PSMOUSE_IMEX,
+		PSMOUSE_TEST_STREAM(imex_data, imex_events),
+		.packets	= 3,
+	},
+	{
+		.name		= "PS2++ MX500",
+		.type		= PSMOUSE_PS2PP,
+		.model		= 112,
+		PSMOUSE_TEST_STREAM(ps2pp_data, ps2pp_events),
+		.packets	= 3,
+	},
+	{
+		.name		= "Synaptics",
+		.type		= PSMOUSE_SYNAPTICS,
+		.model		= 1 << 23,	/* extended capabilities */
+		PSMOUSE_TEST_STREAM(synaptics_data, synaptics_events),
+		.packets	= 2,
+		.bad		= 1,
+	},
+	{
+		.name		= "Lifebook",
+		.type		= PSMOUSE_LIFEBOOK,
+		.model		= 6,
+		PSMOUSE_TEST_STREAM(lifebook_data, lifebook_events),
+		.packets	= 4,
+		.bad		= 1,
+		.check		= psmouse_test_lifebook_check,
+	},
+	{
+		.name		= "FSP",
+		.type		= PSMOUSE_FSP,
+		.model		= 0xd0,		/* STL3888 B0, relative */
+		PSMOUSE_TEST_STREAM(fsp_data, fsp_events),
+		.packets	= 2,
+	},
+	{
+		.name		= "FocalTech",
+		.type		= PSMOUSE_FOCALTECH,
+		.model		= 0x100c,	/* 16 x 12 */
+		PSMOUSE_TEST_STREAM(focaltech_data, focaltech_events),
+		.packets	= 4,
+		.partial	= true,
+	},
+};
+
+static void psmouse_test_serio_release(struct device *dev)
+{
+	kfree(to_serio_port(dev));
+}
+
+/*
+ * The port is only a parent for the test devices and gives the
+ * handlers' log messages a name. It has no write method, so commands
+ * a handler sends fail at once.
+ */
+static int psmouse_test_create_port(void)
+{
+	struct serio *serio;
+	int error;
+
+	serio = kzalloc(sizeof(struct serio), GFP_KERNEL);
+	if (!serio)
+		return -ENOMEM;
+
+	strlcpy(serio->name, "psmouse test port", sizeof(serio->name));
+	strlcpy(serio->phys, "psmouse_test/serio0", sizeof(serio->phys));
+	spin_lock_init(&serio->lock);
+	dev_set_name(&serio->dev, "psmouse_test");
+	serio->dev.release = psmouse_test_serio_release;
+
+	error = device_register(&serio->dev);
+	if (error) {
+		put_device(&serio->dev);
+		return error;
+	}
+
+	psmouse_test_serio = serio;
+	return 0;
+}
+
+static int __init psmouse_test_init(void)
+{
+	unsigned int failed = 0, skipped = 0;
+	unsigned int i;
+	int error;
+
+	error = psmouse_test_create_port();
+	if (error)
+		return error;
+
+	error = input_register_handler(&psmouse_test_handler);
+	if (error) {
+		device_unregister(&psmouse_test_serio->dev);
+		return error;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(psmouse_test_cases); i++) {
+		const struct psmouse_test_case *tc = &psmouse_test_cases[i];
+
+		error = psmouse_test_run(tc);
+		if (error == -ENOSYS) {
+			pr_info("%s: skipped, protocol not built in\n",
+				tc->name);
+			skipped++;
+		} else if (error) {
+			failed++;
+		}
+	}
+
+	input_unregister_handler(&psmouse_test_handler);
+	device_unregister(&psmouse_test_serio->dev);
+
+	pr_info("%u of %zu cases failed, %u skipped\n",
+		failed, ARRAY_SIZE(psmouse_test_cases), skipped);
+
+	return failed ? -EINVAL : 0;
+}
+
+static void __exit psmouse_test_exit(void)
+{
+}
+
+module_init(psmouse_test_init);
+module_exit(psmouse_test_exit);
@@ -81,21 +81,16 @@ static unsigned char fsp_test_invert_cmd(unsigned char reg_val)
 	}
 }
 
-static int fsp_reg_read(struct psmouse *psmouse, int reg_addr, int *reg_val)
+/*
+ * Read a register with the device already deactivated, see fsp_reg_read().
+ */
+static int __fsp_reg_read(struct psmouse *psmouse, int reg_addr, int *reg_val)
 {
 	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param[3];
 	unsigned char addr;
 	int rc = -1;
 
-	/*
-	 * We need to shut off the device and switch it into command
-	 * mode so we don't confuse our protocol handler. We don't need
-	 * to do that for writes because sysfs set helper does this for
-	 * us.
-	 */
-	psmouse_deactivate(psmouse);
-
 	ps2_begin_command(ps2dev);
 
 	if (ps2_sendbyte(ps2dev, 0xf3, FSP_CMD_TIMEOUT) < 0)
@@ -131,13 +126,29 @@ static int fsp_reg_read(struct psmouse *psmouse, int reg_addr, int *reg_val)
 
  out:
 	ps2_end_command(ps2dev);
-	psmouse_activate(psmouse);
 	psmouse_dbg(psmouse,
 		    "READ REG: 0x%02x is 0x%02x (rc = %d)\n",
 		    reg_addr, *reg_val, rc);
 	return rc;
 }
 
+static int fsp_reg_read(struct psmouse *psmouse, int reg_addr, int *reg_val)
+{
+	int rc;
+
+	/*
+	 * We need to shut off the device and switch it into command
+	 * mode so we don't confuse our protocol handler. We don't need
+	 * to do that for writes because sysfs set helper does this for
+	 * us.
+	 */
+	psmouse_deactivate(psmouse);
+	rc = __fsp_reg_read(psmouse, reg_addr, reg_val);
+	psmouse_activate(psmouse);
+
+	return rc;
+}
+
 static int fsp_reg_write(struct psmouse *psmouse, int reg_addr, int reg_val)
 {
 	struct ps2dev *ps2dev = &psmouse->ps2dev;
@@ -211,12 +222,23 @@ static int fsp_reg_write_enable(struct psmouse *psmouse, bool enable)
 	return 0;
 }
 
+/*
+ * The page register only changes when we write it, so once the driver is
+ * bound its value is kept in fsp_data and the device is only asked when
+ * the cached value is unknown (pad->page < 0).
+ */
 static int fsp_page_reg_read(struct psmouse *psmouse, int *reg_val)
 {
+	struct fsp_data *pad = psmouse->private;
 	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char param[3];
 	int rc = -1;
 
+	if (pad && pad->page >= 0) {
+		*reg_val = pad->page;
+		return 0;
+	}
+
 	psmouse_deactivate(psmouse);
 
 	ps2_begin_command(ps2dev);
@@ -240,6 +262,9 @@ static int fsp_page_reg_read(struct psmouse *psmouse, int *reg_val)
 	*reg_val = param[2];
 	rc = 0;
 
+	if (pad)
+		pad->page = *reg_val;
+
  out:
 	ps2_end_command(ps2dev);
 	psmouse_activate(psmouse);
@@ -251,10 +276,14 @@ static int fsp_page_reg_read(struct psmouse *psmouse, int *reg_val)
 
 static int fsp_page_reg_write(struct psmouse *psmouse, int reg_val)
 {
+	struct fsp_data *pad = psmouse->private;
 	struct ps2dev *ps2dev = &psmouse->ps2dev;
 	unsigned char v;
 	int rc = -1;
 
+	if (pad && pad->page == reg_val)
+		return 0;
+
 	ps2_begin_command(ps2dev);
 
 	if (ps2_sendbyte(ps2dev, 0xf3, FSP_CMD_TIMEOUT) < 0)
@@ -281,6 +310,8 @@ static int fsp_page_reg_write(struct psmouse *psmouse, int reg_val)
 
  out:
 	ps2_end_command(ps2dev);
+	if (pad)
+		pad->page = rc ? -1 : reg_val;
 	psmouse_dbg(psmouse,
 		    "WRITE PAGE REG: to 0x%02x (rc = %d)\n",
 		    reg_val, rc);
@@ -452,6 +483,13 @@ static ssize_t fsp_attr_set_setreg(struct psmouse *psmouse, void *data,
 
 	retval = fsp_reg_write(psmouse, reg, val) < 0 ? -EIO : count;
 
+	/* the page may have been changed behind the back of our cache */
+	if (reg == FSP_REG_PAGE_CTRL) {
+		struct fsp_data *pad = psmouse->private;
+
+		pad->page = -1;
+	}
+
 	fsp_reg_write_enable(psmouse, false);
 
 	return count;
@@ -592,8 +630,9 @@ static ssize_t fsp_attr_show_flags(struct psmouse *psmouse,
 {
 	struct fsp_data *pad = psmouse->private;
 
-	return sprintf(buf, "%c\n",
-			pad->flags & FSPDRV_FLAG_EN_OPC ? 'C' : 'c');
+	return sprintf(buf, "%c%c\n",
+			pad->flags & FSPDRV_FLAG_EN_OPC ? 'C' : 'c',
+			psmouse->diag >= PSMOUSE_DIAG_TRACE ? 'D' : 'd');
 }
 
 static ssize_t fsp_attr_set_flags(struct psmouse *psmouse, void *data,
@@ -610,6 +649,13 @@ static ssize_t fsp_attr_set_flags(struct psmouse *psmouse, void *data,
 		case 'c':
 			pad->flags &= ~FSPDRV_FLAG_EN_OPC;
 			break;
+		case 'D':
+			/* packet dumps are the psmouse trace level */
+			psmouse_set_diag(psmouse, PSMOUSE_DIAG_TRACE);
+			break;
+		case 'd':
+			psmouse_set_diag(psmouse, PSMOUSE_DIAG_OFF);
+			break;
 		default:
 			return -EINVAL;
 		}
@@ -643,7 +689,57 @@ static struct attribute_group fsp_attribute_group = {
 	.attrs = fsp_attributes,
 };
 
-#ifdef	FSP_DEBUG
+/*
+ * Dump a range of registers of the current page in one go, keeping the
+ * device deactivated for the whole range instead of for every register.
+ */
+static ssize_t fsp_regs_read(struct file *filp, struct kobject *kobj,
+			     struct bin_attribute *attr, char *buf,
+			     loff_t off, size_t count)
+{
+	struct device *dev = container_of(kobj, struct device, kobj);
+	struct serio *serio = to_serio_port(dev);
+	struct psmouse *psmouse;
+	int i, val;
+	int error;
+
+	if (off >= FSP_NUM_REGS)
+		return 0;
+
+	count = min_t(size_t, count, FSP_NUM_REGS - off);
+
+	/* Same serialization as the other attributes get from psmouse */
+	error = psmouse_lock_interruptible();
+	if (error)
+		return error;
+
+	psmouse = serio_get_drvdata(serio);
+	if (psmouse->state == PSMOUSE_IGNORE) {
+		psmouse_unlock();
+		return -ENODEV;
+	}
+
+	psmouse_deactivate(psmouse);
+
+	for (i = 0; i < count; i++) {
+		if (__fsp_reg_read(psmouse, off + i, &val))
+			break;
+		buf[i] = val;
+	}
+
+	psmouse_activate(psmouse);
+
+	psmouse_unlock();
+
+	return i ? i : -EIO;
+}
+
+static struct bin_attribute fsp_regs_attr = {
+	.attr	= { .name = "regs", .mode = S_IRUSR },
+	.size	= FSP_NUM_REGS,
+	.read	= fsp_regs_read,
+};
+
 static void fsp_packet_debug(struct psmouse *psmouse, unsigned char packet[])
 {
 	static unsigned int ps2_packet_cnt;
@@ -684,11 +780,6 @@ static void fsp_packet_debug(struct psmouse *psmouse, unsigned char packet[])
 		ps2_last_second = jiffies_msec;
 	}
 }
-#else
-static void fsp_packet_debug(struct psmouse *psmouse, unsigned char packet[])
-{
-}
-#endif
 
 static void fsp_set_slot(struct input_dev *dev, int slot, bool active,
 			 unsigned int x, unsigned int y)
@@ -701,156 +792,183 @@ static void fsp_set_slot(struct input_dev *dev, int slot, bool active,
 	}
 }
 
-static psmouse_ret_t fsp_process_byte(struct psmouse *psmouse)
+static void fsp_process_abs(struct psmouse *psmouse, unsigned char *packet)
 {
 	struct input_dev *dev = psmouse->dev;
 	struct fsp_data *ad = psmouse->private;
-	unsigned char *packet = psmouse->packet;
-	unsigned char button_status = 0, lscroll = 0, rscroll = 0;
 	unsigned short abs_x, abs_y, fgrs = 0;
-	int rel_x, rel_y;
 
-	if (psmouse->pktcnt < 4)
-		return PSMOUSE_GOOD_DATA;
+	if ((packet[0] == 0x48 || packet[0] == 0x49) &&
+	    packet[1] == 0 && packet[2] == 0) {
+		/*
+		 * Ignore coordinate noise when finger leaving the
+		 * surface, otherwise cursor may jump to upper-left
+		 * corner.
+		 */
+		packet[3] &= 0xf0;
+	}
+
+	abs_x = GET_ABS_X(packet);
+	abs_y = GET_ABS_Y(packet);
+
+	if (packet[0] & FSP_PB0_MFMC) {
+		/*
+		 * MFMC packet: assume that there are two fingers on
+		 * pad
+		 */
+		fgrs = 2;
+
+		/* MFMC packet */
+		if (packet[0] & FSP_PB0_MFMC_FGR2) {
+			/* 2nd finger */
+			if (ad->last_mt_fgr == 2) {
+				/*
+				 * workaround for buggy firmware
+				 * which doesn't clear MFMC bit if
+				 * the 1st finger is up
+				 */
+				fgrs = 1;
+				fsp_set_slot(dev, 0, false, 0, 0);
+			}
+			ad->last_mt_fgr = 2;
 
+			fsp_set_slot(dev, 1, fgrs == 2, abs_x, abs_y);
+		} else {
+			/* 1st finger */
+			if (ad->last_mt_fgr == 1) {
+				/*
+				 * workaround for buggy firmware
+				 * which doesn't clear MFMC bit if
+				 * the 2nd finger is up
+				 */
+				fgrs = 1;
+				fsp_set_slot(dev, 1, false, 0, 0);
+			}
+			ad->last_mt_fgr = 1;
+			fsp_set_slot(dev, 0, fgrs != 0, abs_x, abs_y);
+		}
+	} else {
+		/* SFAC packet */
+		if ((packet[0] & (FSP_PB0_LBTN|FSP_PB0_PHY_BTN)) ==
+			FSP_PB0_LBTN) {
+			/* On-pad click in SFAC mode should be handled
+			 * by userspace.  On-pad clicks in MFMC mode
+			 * are real clickpad clicks, and not ignored.
+			 */
+			packet[0] &= ~FSP_PB0_LBTN;
+		}
+
+		/* no multi-finger information */
+		ad->last_mt_fgr = 0;
+
+		if (abs_x != 0 && abs_y != 0)
+			fgrs = 1;
+
+		fsp_set_slot(dev, 0, fgrs > 0, abs_x, abs_y);
+		fsp_set_slot(dev, 1, false, 0, 0);
+	}
+	if (fgrs == 1 || (fgrs == 2 && !(packet[0] & FSP_PB0_MFMC_FGR2))) {
+		input_report_abs(dev, ABS_X, abs_x);
+		input_report_abs(dev, ABS_Y, abs_y);
+	}
+	input_report_key(dev, BTN_LEFT, packet[0] & 0x01);
+	input_report_key(dev, BTN_RIGHT, packet[0] & 0x02);
+	input_report_key(dev, BTN_TOUCH, fgrs);
+	input_report_key(dev, BTN_TOOL_FINGER, fgrs == 1);
+	input_report_key(dev, BTN_TOOL_DOUBLETAP, fgrs == 2);
+}
+
+static void fsp_process_normal(struct psmouse *psmouse, unsigned char *packet)
+{
+	struct input_dev *dev = psmouse->dev;
+	unsigned char button_status = 0, lscroll = 0, rscroll = 0;
+	int rel_x, rel_y;
+
+	/* special packet data translation from on-pad packets */
+	if (packet[3] != 0) {
+		if (packet[3] & BIT(0))
+			button_status |= 0x01;	/* wheel down */
+		if (packet[3] & BIT(1))
+			button_status |= 0x0f;	/* wheel up */
+		if (packet[3] & BIT(2))
+			button_status |= BIT(4);/* horizontal left */
+		if (packet[3] & BIT(3))
+			button_status |= BIT(5);/* horizontal right */
+		/* push back to packet queue */
+		if (button_status != 0)
+			packet[3] = button_status;
+		rscroll = (packet[3] >> 4) & 1;
+		lscroll = (packet[3] >> 5) & 1;
+	}
 	/*
-	 * Full packet accumulated, process it
+	 * Processing wheel up/down and extra button events
 	 */
+	input_report_rel(dev, REL_WHEEL,
+			 (int)(packet[3] & 8) - (int)(packet[3] & 7));
+	input_report_rel(dev, REL_HWHEEL, lscroll - rscroll);
+	input_report_key(dev, BTN_BACK, lscroll);
+	input_report_key(dev, BTN_FORWARD, rscroll);
 
-	fsp_packet_debug(psmouse, packet);
+	/*
+	 * Standard PS/2 Mouse
+	 */
+	input_report_key(dev, BTN_LEFT, packet[0] & 1);
+	input_report_key(dev, BTN_MIDDLE, (packet[0] >> 2) & 1);
+	input_report_key(dev, BTN_RIGHT, (packet[0] >> 1) & 1);
 
-	switch (psmouse->packet[0] >> FSP_PKT_TYPE_SHIFT) {
-	case FSP_PKT_TYPE_ABS:
+	rel_x = packet[1] ? (int)packet[1] - (int)((packet[0] << 4) & 0x100) : 0;
+	rel_y = packet[2] ? (int)((packet[0] << 3) & 0x100) - (int)packet[2] : 0;
 
-		if ((packet[0] == 0x48 || packet[0] == 0x49) &&
-		    packet[1] == 0 && packet[2] == 0) {
-			/*
-			 * Ignore coordinate noise when finger leaving the
-			 * surface, otherwise cursor may jump to upper-left
-			 * corner.
-			 */
-			packet[3] &= 0xf0;
-		}
+	input_report_rel(dev, REL_X, rel_x);
+	input_report_rel(dev, REL_Y, rel_y);
+}
 
-		abs_x = GET_ABS_X(packet);
-		abs_y = GET_ABS_Y(packet);
+static void fsp_process_normal_opc(struct psmouse *psmouse,
+				   unsigned char *packet)
+{
+	struct fsp_data *ad = psmouse->private;
 
-		if (packet[0] & FSP_PB0_MFMC) {
-			/*
-			 * MFMC packet: assume that there are two fingers on
-			 * pad
-			 */
-			fgrs = 2;
-
-			/* MFMC packet */
-			if (packet[0] & FSP_PB0_MFMC_FGR2) {
-				/* 2nd finger */
-				if (ad->last_mt_fgr == 2) {
-					/*
-					 * workaround for buggy firmware
-					 * which doesn't clear MFMC bit if
-					 * the 1st finger is up
-					 */
-					fgrs = 1;
-					fsp_set_slot(dev, 0, false, 0, 0);
-				}
-				ad->last_mt_fgr = 2;
-
-				fsp_set_slot(dev, 1, fgrs == 2, abs_x, abs_y);
-			} else {
-				/* 1st finger */
-				if (ad->last_mt_fgr == 1) {
-					/*
-					 * workaround for buggy firmware
-					 * which doesn't clear MFMC bit if
-					 * the 2nd finger is up
-					 */
-					fgrs = 1;
-					fsp_set_slot(dev, 1, false, 0, 0);
-				}
-				ad->last_mt_fgr = 1;
-				fsp_set_slot(dev, 0, fgrs != 0, abs_x, abs_y);
-			}
-		} else {
-			/* SFAC packet */
-			if ((packet[0] & (FSP_PB0_LBTN|FSP_PB0_PHY_BTN)) ==
-				FSP_PB0_LBTN) {
-				/* On-pad click in SFAC mode should be handled
-				 * by userspace.  On-pad clicks in MFMC mode
-				 * are real clickpad clicks, and not ignored.
-				 */
-				packet[0] &= ~FSP_PB0_LBTN;
-			}
+	/* on-pad click, filter it if necessary */
+	if ((ad->flags & FSPDRV_FLAG_EN_OPC) != FSPDRV_FLAG_EN_OPC)
+		packet[0] &= ~FSP_PB0_LBTN;
 
-			/* no multi-finger information */
-			ad->last_mt_fgr = 0;
+	fsp_process_normal(psmouse, packet);
+}
 
-			if (abs_x != 0 && abs_y != 0)
-				fgrs = 1;
+static void fsp_process_notify(struct psmouse *psmouse, unsigned char *packet)
+{
+	/* nothing to report */
+}
 
-			fsp_set_slot(dev, 0, fgrs > 0, abs_x, abs_y);
-			fsp_set_slot(dev, 1, false, 0, 0);
-		}
-		if (fgrs == 1 || (fgrs == 2 && !(packet[0] & FSP_PB0_MFMC_FGR2))) {
-			input_report_abs(dev, ABS_X, abs_x);
-			input_report_abs(dev, ABS_Y, abs_y);
-		}
-		input_report_key(dev, BTN_LEFT, packet[0] & 0x01);
-		input_report_key(dev, BTN_RIGHT, packet[0] & 0x02);
-		input_report_key(dev, BTN_TOUCH, fgrs);
-		input_report_key(dev, BTN_TOOL_FINGER, fgrs == 1);
-		input_report_key(dev, BTN_TOOL_DOUBLETAP, fgrs == 2);
-		break;
+/*
+ * Packet handlers, indexed by the packet type in the top 2 bits of the
+ * first byte.
+ */
+static void (* const fsp_packet_handlers[])(struct psmouse *psmouse,
+					    unsigned char *packet) = {
+	[FSP_PKT_TYPE_NORMAL]		= fsp_process_normal,
+	[FSP_PKT_TYPE_ABS]		= fsp_process_abs,
+	[FSP_PKT_TYPE_NOTIFY]		= fsp_process_notify,
+	[FSP_PKT_TYPE_NORMAL_OPC]	= fsp_process_normal_opc,
+};
 
-	case FSP_PKT_TYPE_NORMAL_OPC:
-		/* on-pad click, filter it if necessary */
-		if ((ad->flags & FSPDRV_FLAG_EN_OPC) != FSPDRV_FLAG_EN_OPC)
-			packet[0] &= ~FSP_PB0_LBTN;
-		/* fall through */
+static psmouse_ret_t fsp_process_byte(struct psmouse *psmouse)
+{
+	unsigned char *packet = psmouse->packet;
 
-	case FSP_PKT_TYPE_NORMAL:
-		/* normal packet */
-		/* special packet data translation from on-pad packets */
-		if (packet[3] != 0) {
-			if (packet[3] & BIT(0))
-				button_status |= 0x01;	/* wheel down */
-			if (packet[3] & BIT(1))
-				button_status |= 0x0f;	/* wheel up */
-			if (packet[3] & BIT(2))
-				button_status |= BIT(4);/* horizontal left */
-			if (packet[3] & BIT(3))
-				button_status |= BIT(5);/* horizontal right */
-			/* push back to packet queue */
-			if (button_status != 0)
-				packet[3] = button_status;
-			rscroll = (packet[3] >> 4) & 1;
-			lscroll = (packet[3] >> 5) & 1;
-		}
-		/*
-		 * Processing wheel up/down and extra button events
-		 */
-		input_report_rel(dev, REL_WHEEL,
-				 (int)(packet[3] & 8) - (int)(packet[3] & 7));
-		input_report_rel(dev, REL_HWHEEL, lscroll - rscroll);
-		input_report_key(dev, BTN_BACK, lscroll);
-		input_report_key(dev, BTN_FORWARD, rscroll);
+	if (psmouse->pktcnt < 4)
+		return PSMOUSE_GOOD_DATA;
 
-		/*
-		 * Standard PS/2 Mouse
-		 */
-		input_report_key(dev, BTN_LEFT, packet[0] & 1);
-		input_report_key(dev, BTN_MIDDLE, (packet[0] >> 2) & 1);
-		input_report_key(dev, BTN_RIGHT, (packet[0] >> 1) & 1);
+	/*
+	 * Full packet accumulated, process it
+	 */
 
-		rel_x = packet[1] ? (int)packet[1] - (int)((packet[0] << 4) & 0x100) : 0;
-		rel_y = packet[2] ? (int)((packet[0] << 3) & 0x100) - (int)packet[2] : 0;
+	if (psmouse_diag_event(psmouse, PSMOUSE_DIAG_PACKET))
+		fsp_packet_debug(psmouse, packet);
 
-		input_report_rel(dev, REL_X, rel_x);
-		input_report_rel(dev, REL_Y, rel_y);
-		break;
-	}
+	fsp_packet_handlers[packet[0] >> FSP_PKT_TYPE_SHIFT](psmouse, packet);
 
-	input_sync(dev);
+	input_sync(psmouse->dev);
 
 	return PSMOUSE_FULL_PACKET;
 }
@@ -1006,6 +1124,8 @@ static void fsp_reset(struct psmouse *psmouse)
 
 static void fsp_disconnect(struct psmouse *psmouse)
 {
+	sysfs_remove_bin_file(&psmouse->ps2dev.serio->dev.kobj,
+			      &fsp_regs_attr);
 	sysfs_remove_group(&psmouse->ps2dev.serio->dev.kobj,
 			   &fsp_attribute_group);
 
@@ -1015,8 +1135,12 @@ static void fsp_disconnect(struct psmouse *psmouse)
 
 static int fsp_reconnect(struct psmouse *psmouse)
 {
+	struct fsp_data *pad = psmouse->private;
 	int version;
 
+	/* the device may have been reset, forget the page we selected */
+	pad->page = -1;
+
 	if (fsp_detect(psmouse, 0))
 		return -ENODEV;
 
@@ -1054,12 +1178,15 @@ int fsp_init(struct psmouse *psmouse)
 
 	priv->ver = ver;
 	priv->rev = rev;
+	priv->page = -1;
 
 	psmouse->protocol_handler = fsp_process_byte;
 	psmouse->disconnect = fsp_disconnect;
 	psmouse->reconnect = fsp_reconnect;
 	psmouse->cleanup = fsp_reset;
 	psmouse->pktsize = 4;
+	/* fsp_packet_debug() replaces the raw packet dump of the core */
+	psmouse->diag_own_packets = true;
 
 	error = fsp_activate_protocol(psmouse);
 	if (error)
@@ -1078,6 +1205,16 @@ int fsp_init(struct psmouse *psmouse)
 		goto err_out;
 	}
 
+	error = sysfs_create_bin_file(&psmouse->ps2dev.serio->dev.kobj,
+				      &fsp_regs_attr);
+	if (error) {
+		psmouse_err(psmouse,
+			    "Failed to create register dump (%d)", error);
+		sysfs_remove_group(&psmouse->ps2dev.serio->dev.kobj,
+				   &fsp_attribute_group);
+		goto err_out;
+	}
+
 	return 0;
 
  err_out:
@@ -1085,3 +1222,24 @@ int fsp_init(struct psmouse *psmouse)
 	psmouse->private = NULL;
 	return error;
 }
+
+#ifdef CONFIG_MOUSE_PS2_TEST
+/* Fixture for psmouse_test.ko; @model is the hardware version. */
+int fsp_test_init(struct psmouse *psmouse, unsigned int model)
+{
+	struct fsp_data *priv;
+
+	psmouse->private = priv = kzalloc(sizeof(struct fsp_data), GFP_KERNEL);
+	if (!priv)
+		return -ENOMEM;
+
+	priv->ver = model;
+	priv->page = -1;
+
+	psmouse->protocol_handler = fsp_process_byte;
+	psmouse->pktsize = 4;
+	psmouse->diag_own_packets = true;
+
+	return fsp_set_input_params(psmouse);
+}
+#endif
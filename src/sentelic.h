@@ -73,6 +73,8 @@
 #define	FSP_REG_SN1		(0x41)
 #define	FSP_REG_SN2		(0x42)
 
+#define	FSP_NUM_REGS		256	/* registers per page */
+
 /* Finger-sensing Pad packet formating related definitions */
 
 /* absolute packet type */
@@ -117,6 +119,7 @@ struct fsp_data {
 	unsigned char	last_reg;	/* Last register we requested read from */
 	unsigned char	last_val;
 	unsigned int	last_mt_fgr;	/* Last seen finger(multitouch) */
+	int		page;		/* Page register, -1 if unknown */
 };
 
 #ifdef CONFIG_MOUSE_PS2_SENTELIC
@@ -133,6 +136,10 @@ static inline int fsp_init(struct psmouse *psmouse)
 }
 #endif
 
+#ifdef CONFIG_MOUSE_PS2_TEST
+int fsp_test_init(struct psmouse *psmouse, unsigned int model);
+#endif
+
 #endif	/* __KERNEL__ */
 
 #endif	/* !__SENTELIC_H */
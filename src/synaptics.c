@@ -26,10 +26,12 @@
 #include <linux/module.h>
 #include <linux/delay.h>
 #include <linux/dmi.h>
+#include <linux/ktime.h>
 #include <linux/input/mt.h>
 #include <linux/serio.h>
 #include <linux/libps2.h>
 #include <linux/slab.h>
+#include <asm/unaligned.h>
 #include "psmouse.h"
 #include "synaptics.h"
 
@@ -89,10 +91,13 @@ static int synaptics_mode_cmd(struct psmouse *psmouse, unsigned char mode)
 	return 0;
 }
 
-int synaptics_detect(struct psmouse *psmouse, bool set_properties)
+/*
+ * Issue the identify query using the short detection sequence. The
+ * response is left in param, which must have room for 3 bytes.
+ */
+static int synaptics_detect_id(struct psmouse *psmouse, unsigned char *param)
 {
 	struct ps2dev *ps2dev = &psmouse->ps2dev;
-	unsigned char param[4];
 
 	param[0] = 0;
 
@@ -102,7 +107,14 @@ int synaptics_detect(struct psmouse *psmouse, bool set_properties)
 	ps2_command(ps2dev, param, PSMOUSE_CMD_SETRES);
 	ps2_command(ps2dev, param, PSMOUSE_CMD_GETINFO);
 
-	if (param[1] != 0x47)
+	return param[1] == 0x47 ? 0 : -ENODEV;
+}
+
+int synaptics_detect(struct psmouse *psmouse, bool set_properties)
+{
+	unsigned char param[4];
+
+	if (synaptics_detect_id(psmouse, param))
 		return -ENODEV;
 
 	if (set_properties) {
@@ -121,6 +133,12 @@ void synaptics_reset(struct psmouse *psmouse)
 
 #ifdef CONFIG_MOUSE_PS2_SYNAPTICS
 
+static bool fast_reconnect = true;
+module_param_named(synaptics_fast_reconnect, fast_reconnect, bool, 0644);
+MODULE_PARM_DESC(synaptics_fast_reconnect,
+	"verify Synaptics identity with a single query on reconnect and only "
+	"re-read all capabilities if it does not match.");
+
 static bool cr48_profile_sensor;
 
 #define ANY_BOARD_ID 0
@@ -523,7 +541,7 @@ static int synaptics_set_mode(struct psmouse *psmouse)
 		priv->mode |= SYN_BIT_ABSOLUTE_MODE;
 	if (priv->disable_gesture)
 		priv->mode |= SYN_BIT_DISABLE_GESTURE;
-	if (psmouse->rate >= 80)
+	if (psmouse->rate >= 80 || priv->report_rate)
 		priv->mode |= SYN_BIT_HIGH_RATE;
 	if (SYN_CAP_EXTENDED(priv->capabilities))
 		priv->mode |= SYN_BIT_W_MODE;
@@ -543,15 +561,28 @@ static int synaptics_set_mode(struct psmouse *psmouse)
 static void synaptics_set_rate(struct psmouse *psmouse, unsigned int rate)
 {
 	struct synaptics_data *priv = psmouse->private;
+	unsigned char mode = priv->mode;
 
-	if (rate >= 80) {
-		priv->mode |= SYN_BIT_HIGH_RATE;
-		psmouse->rate = 80;
-	} else {
-		priv->mode &= ~SYN_BIT_HIGH_RATE;
-		psmouse->rate = 40;
-	}
+	psmouse->rate = rate >= 80 ? 80 : 40;
+
+	/*
+	 * When downsampling on the host we always want the touchpad to
+	 * run at its highest rate, whatever rate was requested.
+	 */
+	if (psmouse->rate >= 80 || priv->report_rate)
+		mode |= SYN_BIT_HIGH_RATE;
+	else
+		mode &= ~SYN_BIT_HIGH_RATE;
 
+	/*
+	 * synaptics_set_mode() has already programmed the mode byte on
+	 * init and reconnect, so only talk to the device if the rate
+	 * actually changes.
+	 */
+	if (mode == priv->mode)
+		return;
+
+	priv->mode = mode;
 	synaptics_mode_cmd(psmouse, priv->mode);
 }
 
@@ -603,13 +634,31 @@ static void synaptics_pass_pt_packet(struct psmouse *psmouse,
 {
 	struct synaptics_data *priv = psmouse->private;
 	struct psmouse *child = serio_get_drvdata(ptport);
+	unsigned char frame[4];
 
 	if (child && child->state == PSMOUSE_ACTIVATED) {
-		serio_interrupt(ptport, packet[1] | priv->pt_buttons, 0);
-		serio_interrupt(ptport, packet[4], 0);
-		serio_interrupt(ptport, packet[5], 0);
+		frame[0] = packet[1] | priv->pt_buttons;
+		frame[1] = packet[4];
+		frame[2] = packet[5];
+		frame[3] = packet[2];
+
+		/*
+		 * The guest may have been switched to a protocol with
+		 * longer packets than we unpack here; feed those byte by
+		 * byte as before.
+		 */
+		if (child->pktsize <= sizeof(frame) &&
+		    psmouse_receive_packet(ptport, frame, child->pktsize)) {
+			priv->pt_direct_packets++;
+			return;
+		}
+
+		priv->pt_slow_packets++;
+		serio_interrupt(ptport, frame[0], 0);
+		serio_interrupt(ptport, frame[1], 0);
+		serio_interrupt(ptport, frame[2], 0);
 		if (child->pktsize == 4)
-			serio_interrupt(ptport, packet[2], 0);
+			serio_interrupt(ptport, frame[3], 0);
 	} else {
 		serio_interrupt(ptport, packet[1], 0);
 	}
@@ -633,10 +682,42 @@ static void synaptics_pt_activate(struct psmouse *psmouse)
 	}
 }
 
+static ssize_t synaptics_show_pt_counter(struct psmouse *psmouse,
+					 void *data, char *buf)
+{
+	struct synaptics_data *priv = psmouse->private;
+	unsigned long *counter = (unsigned long *)((char *)priv + (size_t)data);
+
+	return sprintf(buf, "%lu\n", *counter);
+}
+
+PSMOUSE_DEFINE_RO_ATTR(pt_direct_packets, S_IRUGO,
+		       (void *)offsetof(struct synaptics_data, pt_direct_packets),
+		       synaptics_show_pt_counter);
+PSMOUSE_DEFINE_RO_ATTR(pt_slow_packets, S_IRUGO,
+		       (void *)offsetof(struct synaptics_data, pt_slow_packets),
+		       synaptics_show_pt_counter);
+
+static struct attribute *synaptics_pt_attrs[] = {
+	&psmouse_attr_pt_direct_packets.dattr.attr,
+	&psmouse_attr_pt_slow_packets.dattr.attr,
+	NULL
+};
+
+static struct attribute_group synaptics_pt_attr_group = {
+	.attrs = synaptics_pt_attrs,
+};
+
 static void synaptics_pt_create(struct psmouse *psmouse)
 {
 	struct serio *serio;
 
+	/* Created even without a port, synaptics_disconnect() removes it */
+	if (sysfs_create_group(&psmouse->ps2dev.serio->dev.kobj,
+			       &synaptics_pt_attr_group))
+		psmouse_warn(psmouse,
+			     "failed to create pass-through counters\n");
+
 	serio = kzalloc(sizeof(struct serio), GFP_KERNEL);
 	if (!serio) {
 		psmouse_err(psmouse,
@@ -694,28 +775,52 @@ static void synaptics_parse_ext_buttons(const unsigned char buf[],
 					struct synaptics_data *priv,
 					struct synaptics_hw_state *hw)
 {
-	unsigned int ext_bits =
-		(SYN_CAP_MULTI_BUTTON_NO(priv->ext_cap) + 1) >> 1;
+	unsigned int ext_bits = priv->plan.ext_bits;
 	unsigned int ext_mask = GENMASK(ext_bits - 1, 0);
 
 	hw->ext_buttons = buf[4] & ext_mask;
 	hw->ext_buttons |= (buf[5] & ext_mask) << ext_bits;
 }
 
+/*
+ * Work out once which parts of the absolute packets the touchpad sends,
+ * so that synaptics_parse_hw_state() does not have to go through the
+ * capability bits for every packet.
+ */
+static void synaptics_setup_parse_plan(struct synaptics_data *priv)
+{
+	struct synaptics_parse_plan *plan = &priv->plan;
+
+	plan->newabs = SYN_MODEL_NEWABS(priv->model_id);
+	plan->agm = SYN_CAP_ADV_GESTURE(priv->ext_cap_0c) ||
+		    SYN_CAP_IMAGE_SENSOR(priv->ext_cap_0c);
+	plan->four_button = SYN_CAP_FOUR_BUTTON(priv->capabilities);
+	plan->ext_bits = (SYN_CAP_MULTI_BUTTON_NO(priv->ext_cap) + 1) >> 1;
+
+	if (priv->is_forcepad)
+		plan->buttons = SYN_BUTTONS_FORCEPAD;
+	else if (SYN_CAP_CLICKPAD(priv->ext_cap_0c))
+		plan->buttons = SYN_BUTTONS_CLICKPAD;
+	else if (SYN_CAP_MIDDLE_BUTTON(priv->capabilities))
+		plan->buttons = SYN_BUTTONS_MIDDLE;
+	else
+		plan->buttons = SYN_BUTTONS_PLAIN;
+}
+
 static int synaptics_parse_hw_state(const unsigned char buf[],
 				    struct synaptics_data *priv,
 				    struct synaptics_hw_state *hw)
 {
+	const struct synaptics_parse_plan *plan = &priv->plan;
+
 	memset(hw, 0, sizeof(struct synaptics_hw_state));
 
-	if (SYN_MODEL_NEWABS(priv->model_id)) {
+	if (plan->newabs) {
 		hw->w = (((buf[0] & 0x30) >> 2) |
 			 ((buf[0] & 0x04) >> 1) |
 			 ((buf[3] & 0x04) >> 2));
 
-		if ((SYN_CAP_ADV_GESTURE(priv->ext_cap_0c) ||
-			SYN_CAP_IMAGE_SENSOR(priv->ext_cap_0c)) &&
-		    hw->w == 2) {
+		if (plan->agm && hw->w == 2) {
 			synaptics_parse_agm(buf, priv, hw);
 			return 1;
 		}
@@ -731,7 +836,8 @@ static int synaptics_parse_hw_state(const unsigned char buf[],
 		hw->left  = (buf[0] & 0x01) ? 1 : 0;
 		hw->right = (buf[0] & 0x02) ? 1 : 0;
 
-		if (priv->is_forcepad) {
+		switch (plan->buttons) {
+		case SYN_BUTTONS_FORCEPAD:
 			/*
 			 * ForcePads, like Clickpads, use middle button
 			 * bits to report primary button clicks.
@@ -766,30 +872,31 @@ static int synaptics_parse_hw_state(const unsigned char buf[],
 			}
 
 			hw->left = priv->report_press;
+			break;
 
-		} else if (SYN_CAP_CLICKPAD(priv->ext_cap_0c)) {
+		case SYN_BUTTONS_CLICKPAD:
 			/*
 			 * Clickpad's button is transmitted as middle button,
 			 * however, since it is primary button, we will report
 			 * it as BTN_LEFT.
 			 */
 			hw->left = ((buf[0] ^ buf[3]) & 0x01) ? 1 : 0;
+			break;
 
-		} else if (SYN_CAP_MIDDLE_BUTTON(priv->capabilities)) {
+		case SYN_BUTTONS_MIDDLE:
 			hw->middle = ((buf[0] ^ buf[3]) & 0x01) ? 1 : 0;
 			if (hw->w == 2)
 				hw->scroll = (signed char)(buf[1]);
+			break;
 		}
 
-		if (SYN_CAP_FOUR_BUTTON(priv->capabilities)) {
+		if (plan->four_button) {
 			hw->up   = ((buf[0] ^ buf[3]) & 0x01) ? 1 : 0;
 			hw->down = ((buf[0] ^ buf[3]) & 0x02) ? 1 : 0;
 		}
 
-		if (SYN_CAP_MULTI_BUTTON_NO(priv->ext_cap) > 0 &&
-		    ((buf[0] ^ buf[3]) & 0x02)) {
+		if (plan->ext_bits && ((buf[0] ^ buf[3]) & 0x02))
 			synaptics_parse_ext_buttons(buf, priv, hw);
-		}
 	} else {
 		hw->x = (((buf[1] & 0x1f) << 8) | buf[2]);
 		hw->y = (((buf[4] & 0x1f) << 8) | buf[5]);
@@ -913,6 +1020,62 @@ static void synaptics_report_buttons(struct psmouse *psmouse,
 	synaptics_report_ext_buttons(psmouse, hw);
 }
 
+static int synaptics_mt_dist(const struct input_mt_pos *a,
+			     const struct input_mt_pos *b)
+{
+	return abs(a->x - b->x) + abs(a->y - b->y);
+}
+
+/*
+ * Assign slots to the (at most 2) reported contacts. As long as the
+ * number of contacts does not change, match them against the previous
+ * frame by picking the cheaper of the two possible pairings, and only
+ * swap slots when that wins by more than about a millimetre: the
+ * secondary contact comes from half resolution AGM packets, and swapping
+ * on small differences shows up as jumps during two finger scrolling.
+ * The margin is absolute rather than relative, so that a real swap is
+ * still followed while both fingers move fast. Full slot assignment
+ * is only done when contacts come or go, or jump further than DMAX
+ * (a zero dmax means unlimited, as for input_mt_assign_slots()).
+ */
+static void synaptics_track_contacts(struct psmouse *psmouse,
+				     const struct input_mt_pos *pos,
+				     int *slot, int num)
+{
+	struct synaptics_data *priv = psmouse->private;
+	int dmax = DMAX * priv->x_res;
+	int keep, swap, i;
+
+	if (num == priv->mt_count && num == 1 &&
+	    (!dmax || synaptics_mt_dist(&pos[0], &priv->mt_pos[0]) <= dmax)) {
+		slot[0] = priv->mt_slot[0];
+	} else if (num == priv->mt_count && num == 2) {
+		keep = synaptics_mt_dist(&pos[0], &priv->mt_pos[0]) +
+		       synaptics_mt_dist(&pos[1], &priv->mt_pos[1]);
+		swap = synaptics_mt_dist(&pos[0], &priv->mt_pos[1]) +
+		       synaptics_mt_dist(&pos[1], &priv->mt_pos[0]);
+
+		if (swap + priv->x_res < keep) {
+			slot[0] = priv->mt_slot[1];
+			slot[1] = priv->mt_slot[0];
+		} else {
+			slot[0] = priv->mt_slot[0];
+			slot[1] = priv->mt_slot[1];
+		}
+
+		if (dmax && min(keep, swap) > 2 * dmax)
+			input_mt_assign_slots(psmouse->dev, slot, pos, num, dmax);
+	} else {
+		input_mt_assign_slots(psmouse->dev, slot, pos, num, dmax);
+	}
+
+	for (i = 0; i < num; i++) {
+		priv->mt_pos[i] = pos[i];
+		priv->mt_slot[i] = slot[i];
+	}
+	priv->mt_count = num;
+}
+
 static void synaptics_report_mt_data(struct psmouse *psmouse,
 				     const struct synaptics_hw_state *sgm,
 				     int num_fingers)
@@ -930,7 +1093,7 @@ static void synaptics_report_mt_data(struct psmouse *psmouse,
 		pos[i].y = synaptics_invert_y(hw[i]->y);
 	}
 
-	input_mt_assign_slots(dev, slot, pos, nsemi, DMAX * priv->x_res);
+	synaptics_track_contacts(psmouse, pos, slot, nsemi);
 
 	for (i = 0; i < nsemi; i++) {
 		input_mt_slot(dev, slot[i]);
@@ -953,6 +1116,55 @@ static void synaptics_report_mt_data(struct psmouse *psmouse,
 	input_sync(dev);
 }
 
+/*
+ * Decide whether a sample should be held back instead of being reported,
+ * when host-side downsampling is enabled. Changes in finger count or
+ * button state are always reported right away; motion is reported at
+ * most report_rate times per second. If requested, the reported position
+ * is the average of the samples held back since the previous frame.
+ */
+static bool synaptics_hold_sample(struct synaptics_data *priv,
+				  struct synaptics_hw_state *hw,
+				  int num_fingers, bool average)
+{
+	struct synaptics_downsample *ds = &priv->ds;
+	unsigned int key;
+	ktime_t now;
+
+	if (!priv->report_rate)
+		return false;
+
+	key = hw->left | hw->right << 1 | hw->middle << 2 |
+	      hw->up << 3 | hw->down << 4 |
+	      hw->ext_buttons << 8 | num_fingers << 16;
+	now = ktime_get();
+
+	if (key == ds->key) {
+		if (ktime_before(now, ds->next)) {
+			if (num_fingers > 0) {
+				ds->sum_x += hw->x;
+				ds->sum_y += hw->y;
+				ds->sum_z += hw->z;
+				ds->count++;
+			}
+			return true;
+		}
+
+		if (average && ds->count && num_fingers > 0) {
+			hw->x = (ds->sum_x + hw->x) / (int)(ds->count + 1);
+			hw->y = (ds->sum_y + hw->y) / (int)(ds->count + 1);
+			hw->z = (ds->sum_z + hw->z) / (int)(ds->count + 1);
+		}
+	}
+
+	ds->key = key;
+	ds->count = 0;
+	ds->sum_x = ds->sum_y = ds->sum_z = 0;
+	ds->next = ktime_add_us(now, USEC_PER_SEC / priv->report_rate);
+
+	return false;
+}
+
 static void synaptics_image_sensor_process(struct psmouse *psmouse,
 					   struct synaptics_hw_state *sgm)
 {
@@ -973,6 +1185,13 @@ static void synaptics_image_sensor_process(struct psmouse *psmouse,
 	else
 		num_fingers = 4;
 
+	/*
+	 * Secondary contact comes from separate AGM packets, so do not try
+	 * to average the primary one against it; just skip frames.
+	 */
+	if (synaptics_hold_sample(priv, sgm, num_fingers, false))
+		return;
+
 	/* Send resulting input events to user space */
 	synaptics_report_mt_data(psmouse, sgm, num_fingers);
 }
@@ -1040,6 +1259,15 @@ static void synaptics_process_packet(struct psmouse *psmouse)
 		finger_width = 0;
 	}
 
+	/*
+	 * Semi-MT reports the AGM contact next to this one; averaging only
+	 * the primary would pull the two apart, so only skip frames there.
+	 */
+	if (synaptics_hold_sample(priv, &hw, num_fingers,
+				  priv->report_average && !cr48_profile_sensor &&
+				  !SYN_CAP_ADV_GESTURE(priv->ext_cap_0c)))
+		return;
+
 	if (cr48_profile_sensor) {
 		synaptics_report_mt_data(psmouse, &hw, num_fingers);
 		return;
@@ -1076,50 +1304,53 @@ static void synaptics_process_packet(struct psmouse *psmouse)
 	input_sync(dev);
 }
 
-static int synaptics_validate_byte(struct psmouse *psmouse,
-				   int idx, unsigned char pkt_type)
-{
-	static const unsigned char newabs_mask[]	= { 0xC8, 0x00, 0x00, 0xC8, 0x00 };
-	static const unsigned char newabs_rel_mask[]	= { 0xC0, 0x00, 0x00, 0xC0, 0x00 };
-	static const unsigned char newabs_rslt[]	= { 0x80, 0x00, 0x00, 0xC0, 0x00 };
-	static const unsigned char oldabs_mask[]	= { 0xC0, 0x60, 0x00, 0xC0, 0x60 };
-	static const unsigned char oldabs_rslt[]	= { 0xC0, 0x00, 0x00, 0x80, 0x00 };
-	const char *packet = psmouse->packet;
-
-	if (idx < 0 || idx > 4)
-		return 0;
-
-	switch (pkt_type) {
-
-	case SYN_NEWABS:
-	case SYN_NEWABS_RELAXED:
-		return (packet[idx] & newabs_rel_mask[idx]) == newabs_rslt[idx];
+/*
+ * Fixed bits of the first 5 bytes of each packet type, packed little
+ * endian: byte n of the packet is checked against bits 8n..8n+7.
+ */
+static const struct {
+	u64 mask;
+	u64 rslt;
+} synaptics_pkt_bits[] = {
+	[SYN_NEWABS]		= { 0x00c00000c0ULL, 0x00c0000080ULL },
+	[SYN_NEWABS_STRICT]	= { 0x00c80000c8ULL, 0x00c0000080ULL },
+	[SYN_NEWABS_RELAXED]	= { 0x00c00000c0ULL, 0x00c0000080ULL },
+	[SYN_OLDABS]		= { 0x60c00060c0ULL, 0x00800000c0ULL },
+};
 
-	case SYN_NEWABS_STRICT:
-		return (packet[idx] & newabs_mask[idx]) == newabs_rslt[idx];
+static bool synaptics_validate_packet(const unsigned char *packet,
+				      unsigned char pkt_type)
+{
+	return (get_unaligned_le64(packet) & synaptics_pkt_bits[pkt_type].mask) ==
+		synaptics_pkt_bits[pkt_type].rslt;
+}
 
-	case SYN_OLDABS:
-		return (packet[idx] & oldabs_mask[idx]) == oldabs_rslt[idx];
+static bool synaptics_validate_byte(const unsigned char *packet,
+				    int idx, unsigned char pkt_type)
+{
+	unsigned int shift = idx * 8;
 
-	default:
-		psmouse_err(psmouse, "unknown packet type %d\n", pkt_type);
-		return 0;
-	}
+	return (packet[idx] & (u8)(synaptics_pkt_bits[pkt_type].mask >> shift)) ==
+		(u8)(synaptics_pkt_bits[pkt_type].rslt >> shift);
 }
 
 static unsigned char synaptics_detect_pkt_type(struct psmouse *psmouse)
 {
-	int i;
-
-	for (i = 0; i < 5; i++)
-		if (!synaptics_validate_byte(psmouse, i, SYN_NEWABS_STRICT)) {
-			psmouse_info(psmouse, "using relaxed packet validation\n");
-			return SYN_NEWABS_RELAXED;
-		}
+	if (!synaptics_validate_packet(psmouse->packet, SYN_NEWABS_STRICT)) {
+		psmouse_info(psmouse, "using relaxed packet validation\n");
+		return SYN_NEWABS_RELAXED;
+	}
 
 	return SYN_NEWABS_STRICT;
 }
 
+/*
+ * Every byte is checked as it arrives so that a corrupted packet is
+ * dropped at the first bad byte and we regain sync from there. The
+ * whole-packet check is only used once, to pick strict or relaxed
+ * validation; psmouse->packet is 8 bytes long, so reading it as a u64
+ * is safe.
+ */
 static psmouse_ret_t synaptics_process_byte(struct psmouse *psmouse)
 {
 	struct synaptics_data *priv = psmouse->private;
@@ -1139,7 +1370,8 @@ static psmouse_ret_t synaptics_process_byte(struct psmouse *psmouse)
 		return PSMOUSE_FULL_PACKET;
 	}
 
-	return synaptics_validate_byte(psmouse, psmouse->pktcnt - 1, priv->pkt_type) ?
+	return synaptics_validate_byte(psmouse->packet, psmouse->pktcnt - 1,
+				       priv->pkt_type) ?
 		PSMOUSE_GOOD_DATA : PSMOUSE_BAD_DATA;
 }
 
@@ -1295,6 +1527,84 @@ PSMOUSE_DEFINE_ATTR(disable_gesture, S_IWUSR | S_IRUGO, NULL,
 		    synaptics_show_disable_gesture,
 		    synaptics_set_disable_gesture);
 
+static ssize_t synaptics_show_report_rate(struct psmouse *psmouse,
+					  void *data, char *buf)
+{
+	struct synaptics_data *priv = psmouse->private;
+
+	return sprintf(buf, "%u\n", priv->report_rate);
+}
+
+static ssize_t synaptics_set_report_rate(struct psmouse *psmouse,
+					 void *data, const char *buf,
+					 size_t len)
+{
+	struct synaptics_data *priv = psmouse->private;
+	unsigned int value;
+	int err;
+
+	err = kstrtouint(buf, 10, &value);
+	if (err)
+		return err;
+
+	/* The touchpad does not go faster than 80 packets per second */
+	if (value > 80)
+		return -EINVAL;
+
+	priv->report_rate = value;
+	memset(&priv->ds, 0, sizeof(priv->ds));
+
+	synaptics_set_rate(psmouse, psmouse->rate);
+
+	return len;
+}
+
+PSMOUSE_DEFINE_ATTR(report_rate, S_IWUSR | S_IRUGO, NULL,
+		    synaptics_show_report_rate,
+		    synaptics_set_report_rate);
+
+static ssize_t synaptics_show_report_average(struct psmouse *psmouse,
+					     void *data, char *buf)
+{
+	struct synaptics_data *priv = psmouse->private;
+
+	return sprintf(buf, "%c\n", priv->report_average ? '1' : '0');
+}
+
+static ssize_t synaptics_set_report_average(struct psmouse *psmouse,
+					    void *data, const char *buf,
+					    size_t len)
+{
+	struct synaptics_data *priv = psmouse->private;
+	unsigned int value;
+	int err;
+
+	err = kstrtouint(buf, 10, &value);
+	if (err)
+		return err;
+
+	if (value > 1)
+		return -EINVAL;
+
+	priv->report_average = value;
+
+	return len;
+}
+
+PSMOUSE_DEFINE_ATTR(report_average, S_IWUSR | S_IRUGO, NULL,
+		    synaptics_show_report_average,
+		    synaptics_set_report_average);
+
+static struct attribute *synaptics_abs_attrs[] = {
+	&psmouse_attr_report_rate.dattr.attr,
+	&psmouse_attr_report_average.dattr.attr,
+	NULL
+};
+
+static struct attribute_group synaptics_abs_attr_group = {
+	.attrs = synaptics_abs_attrs,
+};
+
 static void synaptics_disconnect(struct psmouse *psmouse)
 {
 	struct synaptics_data *priv = psmouse->private;
@@ -1303,6 +1613,14 @@ static void synaptics_disconnect(struct psmouse *psmouse)
 		device_remove_file(&psmouse->ps2dev.serio->dev,
 				   &psmouse_attr_disable_gesture.dattr);
 
+	if (priv->absolute_mode)
+		sysfs_remove_group(&psmouse->ps2dev.serio->dev.kobj,
+				   &synaptics_abs_attr_group);
+
+	if (SYN_CAP_PASS_THROUGH(priv->capabilities))
+		sysfs_remove_group(&psmouse->ps2dev.serio->dev.kobj,
+				   &synaptics_pt_attr_group);
+
 	synaptics_reset(psmouse);
 	kfree(priv);
 	psmouse->private = NULL;
@@ -1312,10 +1630,14 @@ static int synaptics_reconnect(struct psmouse *psmouse)
 {
 	struct synaptics_data *priv = psmouse->private;
 	struct synaptics_data old_priv = *priv;
-	unsigned char param[2];
+	unsigned char param[3];
+	ktime_t start, detected, queried;
+	bool full_query;
 	int retry = 0;
 	int error;
 
+	start = ktime_get();
+
 	do {
 		psmouse_reset(psmouse);
 		if (retry) {
@@ -1329,7 +1651,7 @@ static int synaptics_reconnect(struct psmouse *psmouse)
 			ssleep(1);
 		}
 		ps2_command(&psmouse->ps2dev, param, PSMOUSE_CMD_GETID);
-		error = synaptics_detect(psmouse, 0);
+		error = synaptics_detect_id(psmouse, param);
 	} while (error && ++retry < 3);
 
 	if (error)
@@ -1338,16 +1660,40 @@ static int synaptics_reconnect(struct psmouse *psmouse)
 	if (retry > 1)
 		psmouse_dbg(psmouse, "reconnected after %d tries\n", retry);
 
-	if (synaptics_query_hardware(psmouse)) {
-		psmouse_err(psmouse, "Unable to query device.\n");
-		return -1;
+	detected = ktime_get();
+
+	/*
+	 * The detection sequence above already returned the identify
+	 * query response. If it matches what we saw at init time and the
+	 * device did not announce itself as new, it is the same touchpad
+	 * and there is no point in re-reading the rest of its queries.
+	 */
+	full_query = !fast_reconnect || psmouse->bat_seen ||
+		((param[0] << 16) | (param[1] << 8) | param[2]) != priv->identity;
+
+	if (full_query) {
+		if (synaptics_query_hardware(psmouse)) {
+			psmouse_err(psmouse, "Unable to query device.\n");
+			return -1;
+		}
+
+		synaptics_setup_parse_plan(priv);
 	}
 
+	queried = ktime_get();
+
 	if (synaptics_set_mode(psmouse)) {
 		psmouse_err(psmouse, "Unable to initialize device.\n");
 		return -1;
 	}
 
+	psmouse_dbg(psmouse,
+		    "%s reconnect: detect %lldus, query %lldus, set mode %lldus\n",
+		    full_query ? "full" : "fast",
+		    ktime_us_delta(detected, start),
+		    ktime_us_delta(queried, detected),
+		    ktime_us_delta(ktime_get(), queried));
+
 	if (old_priv.identity != priv->identity ||
 	    old_priv.model_id != priv->model_id ||
 	    old_priv.capabilities != priv->capabilities ||
@@ -1482,6 +1828,7 @@ static int __synaptics_init(struct psmouse *psmouse, bool absolute_mode)
 	}
 
 	priv->pkt_type = SYN_MODEL_NEWABS(priv->model_id) ? SYN_NEWABS : SYN_OLDABS;
+	synaptics_setup_parse_plan(priv);
 
 	psmouse_info(psmouse,
 		     "Touchpad model: %ld, fw: %ld.%ld, id: %#lx, caps: %#lx/%#lx/%#lx/%#lx, board id: %lu, fw id: %lu\n",
@@ -1519,9 +1866,6 @@ static int __synaptics_init(struct psmouse *psmouse, bool absolute_mode)
 	/* Synaptics can usually stay in sync without extra help */
 	psmouse->resync_time = 0;
 
-	if (SYN_CAP_PASS_THROUGH(priv->capabilities))
-		synaptics_pt_create(psmouse);
-
 	/*
 	 * Toshiba's KBC seems to have trouble handling data from
 	 * Synaptics at full rate.  Switch to a lower rate (roughly
@@ -1545,6 +1889,25 @@ static int __synaptics_init(struct psmouse *psmouse, bool absolute_mode)
 		}
 	}
 
+	if (priv->absolute_mode) {
+		err = sysfs_create_group(&psmouse->ps2dev.serio->dev.kobj,
+					 &synaptics_abs_attr_group);
+		if (err) {
+			psmouse_err(psmouse,
+				    "Failed to create report rate attributes (%d)",
+				    err);
+			goto init_fail;
+		}
+	}
+
+	/*
+	 * Nothing may fail after this point: the pass-through port is
+	 * registered asynchronously and cannot be unregistered from here,
+	 * as serio core holds its mutex while we are being connected.
+	 */
+	if (SYN_CAP_PASS_THROUGH(priv->capabilities))
+		synaptics_pt_create(psmouse);
+
 	return 0;
 
  init_fail:
@@ -1562,6 +1925,35 @@ int synaptics_init_relative(struct psmouse *psmouse)
 	return __synaptics_init(psmouse, false);
 }
 
+#ifdef CONFIG_MOUSE_PS2_TEST
+/*
+ * Fixture for psmouse_test.ko: an absolute mode touchpad using the new
+ * packet format, with @model as its capabilities. No pass-through port
+ * is created.
+ */
+int synaptics_test_init(struct psmouse *psmouse, unsigned int model)
+{
+	struct synaptics_data *priv;
+
+	psmouse->private = priv = kzalloc(sizeof(struct synaptics_data), GFP_KERNEL);
+	if (!priv)
+		return -ENOMEM;
+
+	priv->model_id = 1 << 7;	/* SYN_MODEL_NEWABS */
+	priv->capabilities = model;
+	priv->absolute_mode = true;
+	priv->pkt_type = SYN_NEWABS;
+	synaptics_setup_parse_plan(priv);
+
+	set_input_params(psmouse, priv);
+
+	psmouse->protocol_handler = synaptics_process_byte;
+	psmouse->pktsize = 6;
+
+	return 0;
+}
+#endif
+
 #else /* CONFIG_MOUSE_PS2_SYNAPTICS */
 
 void __init synaptics_module_init(void)
@@ -9,6 +9,8 @@
 #ifndef _SYNAPTICS_H
 #define _SYNAPTICS_H
 
+#include <linux/input/mt.h>
+
 /* synaptics queries */
 #define SYN_QUE_IDENTIFY		0x00
 #define SYN_QUE_MODES			0x01
@@ -161,6 +163,37 @@ struct synaptics_hw_state {
 	signed char scroll;
 };
 
+/*
+ * How to decode the capability dependent parts of an absolute packet.
+ * Computed once from the touchpad capabilities so that the packet path
+ * does not have to re-evaluate them for every packet.
+ */
+enum synaptics_button_type {
+	SYN_BUTTONS_PLAIN,		/* left/right only */
+	SYN_BUTTONS_FORCEPAD,		/* primary click from pressure */
+	SYN_BUTTONS_CLICKPAD,		/* primary click in middle bit */
+	SYN_BUTTONS_MIDDLE,		/* middle button and scroll */
+};
+
+struct synaptics_parse_plan {
+	bool newabs;			/* new absolute packet format */
+	bool agm;			/* W=2 packets carry AGM data */
+	bool four_button;		/* up/down buttons */
+	unsigned char buttons;		/* enum synaptics_button_type */
+	unsigned char ext_bits;		/* ext buttons per byte, 0 = none */
+};
+
+/*
+ * State of host-side downsampling: samples the touchpad sends at high
+ * rate are held back and reported at most report_rate times per second.
+ */
+struct synaptics_downsample {
+	ktime_t next;				/* earliest time of next frame */
+	unsigned int key;			/* fingers/buttons of last frame */
+	unsigned int count;			/* samples held since last frame */
+	int sum_x, sum_y, sum_z;		/* sums of held samples */
+};
+
 struct synaptics_data {
 	/* Data read from the touchpad */
 	unsigned long int model_id;		/* Model-ID */
@@ -176,14 +209,21 @@ struct synaptics_data {
 	unsigned int x_min, y_min;		/* Min coordinates (from FW) */
 
 	unsigned char pkt_type;			/* packet type - old, new, etc */
+	struct synaptics_parse_plan plan;	/* packet decoding plan */
 	unsigned char mode;			/* current mode byte */
 	int scroll;
 
 	bool absolute_mode;			/* run in Absolute mode */
 	bool disable_gesture;			/* disable gestures */
 
+	unsigned int report_rate;		/* frames/sec to report, 0 = all */
+	bool report_average;			/* average held back samples */
+	struct synaptics_downsample ds;
+
 	struct serio *pt_port;			/* Pass-through serio port */
 	unsigned char pt_buttons;		/* Pass-through buttons */
+	unsigned long pt_direct_packets;	/* guest packets delivered whole */
+	unsigned long pt_slow_packets;		/* guest packets fed byte by byte */
 
 	/*
 	 * Last received Advanced Gesture Mode (AGM) packet. An AGM packet
@@ -192,6 +232,11 @@ struct synaptics_data {
 	struct synaptics_hw_state agm;
 	unsigned int agm_count;			/* finger count reported by agm */
 
+	/* Contacts reported in the previous MT frame, for slot tracking */
+	struct input_mt_pos mt_pos[2];
+	int mt_slot[2];
+	int mt_count;
+
 	/* ForcePad handling */
 	unsigned long				press_start;
 	bool					press;
@@ -205,4 +250,8 @@ int synaptics_init(struct psmouse *psmouse);
 int synaptics_init_relative(struct psmouse *psmouse);
 void synaptics_reset(struct psmouse *psmouse);
 
+#ifdef CONFIG_MOUSE_PS2_TEST
+int synaptics_test_init(struct psmouse *psmouse, unsigned int model);
+#endif
+
 #endif /* _SYNAPTICS_H */
@@ -193,27 +193,6 @@ PSMOUSE_DEFINE_ATTR(_name, S_IWUSR | S_IRUGO,				\
 		    &trackpoint_attr_##_name,				\
 		    trackpoint_show_int_attr, trackpoint_set_bit_attr)
 
-#define TRACKPOINT_UPDATE_BIT(_psmouse, _tp, _name)			\
-do {									\
-	struct trackpoint_attr_data *_attr = &trackpoint_attr_##_name;	\
-									\
-	trackpoint_update_bit(&_psmouse->ps2dev,			\
-			_attr->command, _attr->mask, _tp->_name);	\
-} while (0)
-
-#define TRACKPOINT_UPDATE(_power_on, _psmouse, _tp, _name)		\
-do {									\
-	if (!_power_on ||						\
-	    _tp->_name != trackpoint_attr_##_name.power_on_default) {	\
-		if (!trackpoint_attr_##_name.mask)			\
-			trackpoint_write(&_psmouse->ps2dev,		\
-				 trackpoint_attr_##_name.command,	\
-				 _tp->_name);				\
-		else							\
-			TRACKPOINT_UPDATE_BIT(_psmouse, _tp, _name);	\
-	}								\
-} while (0)
-
 #define TRACKPOINT_SET_POWER_ON_DEFAULT(_tp, _name)				\
 	(_tp->_name = trackpoint_attr_##_name.power_on_default)
 
@@ -236,6 +215,175 @@ TRACKPOINT_BIT_ATTR(skipback, TP_TOGGLE_SKIPBACK, TP_MASK_SKIPBACK, 0,
 TRACKPOINT_BIT_ATTR(ext_dev, TP_TOGGLE_EXT_DEV, TP_MASK_EXT_DEV, 1,
 		    TP_DEF_EXT_DEV);
 
+/*
+ * Settable properties, in the order trackpoint_sync() writes them.
+ */
+static struct psmouse_attribute *trackpoint_fields[] = {
+	&psmouse_attr_sensitivity,
+	&psmouse_attr_inertia,
+	&psmouse_attr_speed,
+	&psmouse_attr_reach,
+	&psmouse_attr_draghys,
+	&psmouse_attr_mindrag,
+	&psmouse_attr_thresh,
+	&psmouse_attr_upthresh,
+	&psmouse_attr_ztime,
+	&psmouse_attr_jenks,
+	&psmouse_attr_drift_time,
+
+	/* toggles */
+	&psmouse_attr_press_to_select,
+	&psmouse_attr_skipback,
+	&psmouse_attr_ext_dev,
+};
+
+static unsigned char *trackpoint_field(struct trackpoint_data *tp,
+				       const struct trackpoint_attr_data *attr)
+{
+	return (unsigned char *)tp + attr->field_offset;
+}
+
+/*
+ * Push a property to the device.  If the cached value is known the
+ * toggle bits are flipped directly, otherwise they are read back first.
+ */
+static int trackpoint_update_field(struct psmouse *psmouse,
+				   const struct trackpoint_attr_data *attr,
+				   unsigned char value, const unsigned char *old)
+{
+	struct ps2dev *ps2dev = &psmouse->ps2dev;
+
+	if (!attr->mask)
+		return trackpoint_write(ps2dev, attr->command, value);
+
+	if (!old)
+		return trackpoint_update_bit(ps2dev, attr->command,
+					     attr->mask, value);
+
+	if (*old != value)
+		return trackpoint_toggle_bit(ps2dev, attr->command, attr->mask);
+
+	return 0;
+}
+
+/*
+ * The profile attribute reads and writes all properties at once as
+ * "name=value" pairs, using the same values as the individual
+ * attributes.  Only the properties that differ from the cached ones
+ * are sent to the device, and they all go out within the single
+ * deactivate/activate cycle of psmouse_attr_set_helper().  Properties
+ * left out of a write keep their current value.
+ */
+static ssize_t trackpoint_show_profile(struct psmouse *psmouse, void *data,
+				       char *buf)
+{
+	struct trackpoint_data *tp = psmouse->private;
+	const struct trackpoint_attr_data *attr;
+	unsigned char value;
+	int i, len = 0;
+
+	for (i = 0; i < ARRAY_SIZE(trackpoint_fields); i++) {
+		attr = trackpoint_fields[i]->data;
+		value = *trackpoint_field(tp, attr);
+		if (attr->inverted)
+			value = !value;
+
+		len += sprintf(buf + len, "%s%s=%u", i ? " " : "",
+			       trackpoint_fields[i]->dattr.attr.name, value);
+	}
+
+	len += sprintf(buf + len, "\n");
+
+	return len;
+}
+
+static const struct trackpoint_attr_data *
+trackpoint_find_field(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(trackpoint_fields); i++)
+		if (!strcmp(trackpoint_fields[i]->dattr.attr.name, name))
+			return trackpoint_fields[i]->data;
+
+	return NULL;
+}
+
+static int trackpoint_parse_profile(char *str, struct trackpoint_data *new)
+{
+	const struct trackpoint_attr_data *attr;
+	char *token, *name;
+	unsigned char value;
+	int err;
+
+	while ((token = strsep(&str, " \t\n")) != NULL) {
+		if (!*token)
+			continue;
+
+		name = strsep(&token, "=");
+		if (!token)
+			return -EINVAL;
+
+		attr = trackpoint_find_field(name);
+		if (!attr)
+			return -EINVAL;
+
+		err = kstrtou8(token, 10, &value);
+		if (err)
+			return err;
+
+		if (attr->mask) {
+			if (value > 1)
+				return -EINVAL;
+			if (attr->inverted)
+				value = !value;
+		}
+
+		*trackpoint_field(new, attr) = value;
+	}
+
+	return 0;
+}
+
+static ssize_t trackpoint_set_profile(struct psmouse *psmouse, void *data,
+				      const char *buf, size_t count)
+{
+	struct trackpoint_data *tp = psmouse->private;
+	struct trackpoint_data new = *tp;
+	const struct trackpoint_attr_data *attr;
+	unsigned char *field, value;
+	char *str;
+	int i, err;
+
+	str = kstrndup(buf, count, GFP_KERNEL);
+	if (!str)
+		return -ENOMEM;
+
+	err = trackpoint_parse_profile(str, &new);
+	kfree(str);
+	if (err)
+		return err;
+
+	for (i = 0; i < ARRAY_SIZE(trackpoint_fields); i++) {
+		attr = trackpoint_fields[i]->data;
+		field = trackpoint_field(tp, attr);
+		value = *trackpoint_field(&new, attr);
+
+		if (*field == value)
+			continue;
+
+		if (trackpoint_update_field(psmouse, attr, value, field))
+			return -EIO;
+
+		*field = value;
+	}
+
+	return count;
+}
+
+PSMOUSE_DEFINE_ATTR(profile, S_IWUSR | S_IRUGO, NULL,
+		    trackpoint_show_profile, trackpoint_set_profile);
+
 static struct attribute *trackpoint_attrs[] = {
 	&psmouse_attr_sensitivity.dattr.attr,
 	&psmouse_attr_speed.dattr.attr,
@@ -251,6 +399,7 @@ static struct attribute *trackpoint_attrs[] = {
 	&psmouse_attr_press_to_select.dattr.attr,
 	&psmouse_attr_skipback.dattr.attr,
 	&psmouse_attr_ext_dev.dattr.attr,
+	&psmouse_attr_profile.dattr.attr,
 	NULL
 };
 
@@ -283,6 +432,9 @@ static int trackpoint_start_protocol(struct psmouse *psmouse, unsigned char *fir
 static int trackpoint_sync(struct psmouse *psmouse, bool in_power_on_state)
 {
 	struct trackpoint_data *tp = psmouse->private;
+	const struct trackpoint_attr_data *attr;
+	unsigned char value;
+	int i;
 
 	if (!in_power_on_state) {
 		/*
@@ -304,22 +456,13 @@ static int trackpoint_sync(struct psmouse *psmouse, bool in_power_on_state)
 	 * configure them if the values are non-default or if the TP is in
 	 * an unknown state.
 	 */
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, sensitivity);
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, inertia);
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, speed);
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, reach);
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, draghys);
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, mindrag);
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, thresh);
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, upthresh);
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, ztime);
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, jenks);
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, drift_time);
+	for (i = 0; i < ARRAY_SIZE(trackpoint_fields); i++) {
+		attr = trackpoint_fields[i]->data;
+		value = *trackpoint_field(tp, attr);
 
-	/* toggles */
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, press_to_select);
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, skipback);
-	TRACKPOINT_UPDATE(in_power_on_state, psmouse, tp, ext_dev);
+		if (!in_power_on_state || value != attr->power_on_default)
+			trackpoint_update_field(psmouse, attr, value, NULL);
+	}
 
 	return 0;
 }
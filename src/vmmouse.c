@@ -23,35 +23,14 @@
 #include "psmouse.h"
 #include "vmmouse.h"
 
-#define VMMOUSE_PROTO_MAGIC			0x564D5868U
 #define VMMOUSE_PROTO_PORT			0x5658
 
-/*
- * Main commands supported by the vmmouse hypervisor port.
- */
-#define VMMOUSE_PROTO_CMD_GETVERSION		10
-#define VMMOUSE_PROTO_CMD_ABSPOINTER_DATA	39
-#define VMMOUSE_PROTO_CMD_ABSPOINTER_STATUS	40
-#define VMMOUSE_PROTO_CMD_ABSPOINTER_COMMAND	41
-#define VMMOUSE_PROTO_CMD_ABSPOINTER_RESTRICT   86
-
-/*
- * Subcommands for VMMOUSE_PROTO_CMD_ABSPOINTER_COMMAND
- */
-#define VMMOUSE_CMD_ENABLE			0x45414552U
-#define VMMOUSE_CMD_DISABLE			0x000000f5U
-#define VMMOUSE_CMD_REQUEST_RELATIVE		0x4c455252U
-#define VMMOUSE_CMD_REQUEST_ABSOLUTE		0x53424152U
-
-#define VMMOUSE_ERROR				0xffff0000U
-
-#define VMMOUSE_VERSION_ID			0x3442554aU
-
-#define VMMOUSE_RELATIVE_PACKET			0x00010000U
-
 #define VMMOUSE_LEFT_BUTTON			0x20
 #define VMMOUSE_RIGHT_BUTTON			0x10
 #define VMMOUSE_MIDDLE_BUTTON			0x08
+#define VMMOUSE_BUTTONS				(VMMOUSE_LEFT_BUTTON | \
+						 VMMOUSE_RIGHT_BUTTON | \
+						 VMMOUSE_MIDDLE_BUTTON)
 
 /*
  * VMMouse Restrict command
@@ -72,33 +51,103 @@
  * @abs_dev: "Absolute" device used to report absolute mouse movement.
  * @phys: Physical path for the absolute device.
  * @dev_name: Name attribute name for the absolute device.
+ * @buttons: Button state of the last fully reported record.
+ * @pending: Type of coalesced motion not yet reported, or 0 for none.
+ * @x: Pending absolute position or accumulated relative motion.
+ * @y: Pending absolute position or accumulated relative motion.
+ * @backdoor_calls: Hypervisor port accesses made while draining.
+ * @events: Records read from the absolute pointer queue.
+ * @frames: Input frames (syncs) emitted for those records.
  */
 struct vmmouse_data {
 	struct input_dev *abs_dev;
 	char phys[32];
 	char dev_name[128];
+	u32 buttons;
+	u32 pending;
+	s32 x, y;
+	unsigned long backdoor_calls;
+	unsigned long events;
+	unsigned long frames;
 };
 
+#define VMMOUSE_PENDING_ABS			0x1
+#define VMMOUSE_PENDING_REL			0x2
+
 /**
+ * vmmouse_port_call - issue a command on the hypervisor port
+ *
  * Hypervisor-specific bi-directional communication channel
  * implementing the vmmouse protocol. Should never execute on
  * bare metal hardware.
  */
-#define VMMOUSE_CMD(cmd, in1, out1, out2, out3, out4)	\
-({							\
-	unsigned long __dummy1, __dummy2;		\
-	__asm__ __volatile__ ("inl %%dx" :		\
-		"=a"(out1),				\
-		"=b"(out2),				\
-		"=c"(out3),				\
-		"=d"(out4),				\
-		"=S"(__dummy1),				\
-		"=D"(__dummy2) :			\
-		"a"(VMMOUSE_PROTO_MAGIC),		\
-		"b"(in1),				\
-		"c"(VMMOUSE_PROTO_CMD_##cmd),		\
-		"d"(VMMOUSE_PROTO_PORT) :		\
-		"memory");		                \
+static void vmmouse_port_call(u32 cmd, u32 in1, u32 *out)
+{
+	unsigned long dummy1, dummy2;
+
+	__asm__ __volatile__ ("inl %%dx" :
+		"=a"(out[0]),
+		"=b"(out[1]),
+		"=c"(out[2]),
+		"=d"(out[3]),
+		"=S"(dummy1),
+		"=D"(dummy2) :
+		"a"(VMMOUSE_PROTO_MAGIC),
+		"b"(in1),
+		"c"(cmd),
+		"d"(VMMOUSE_PROTO_PORT) :
+		"memory");
+}
+
+static int vmmouse_port_request(void)
+{
+	return request_region(VMMOUSE_PROTO_PORT, 4, "vmmouse") ? 0 : -EBUSY;
+}
+
+static void vmmouse_port_release(void)
+{
+	release_region(VMMOUSE_PROTO_PORT, 4);
+}
+
+static bool vmmouse_check_hypervisor(void);
+
+static const struct vmmouse_backdoor_ops vmmouse_port_ops = {
+	.name		= "port",
+	.probe		= vmmouse_check_hypervisor,
+	.request	= vmmouse_port_request,
+	.release	= vmmouse_port_release,
+	.call		= vmmouse_port_call,
+};
+
+/**
+ * vmmouse_get_backdoor - select the transport for a ps/2 port
+ *
+ * @psmouse: Pointer to the psmouse struct
+ *
+ * The simulated backdoor only ever serves the simulated serio port, real
+ * ports always go through the hypervisor port.
+ */
+static const struct vmmouse_backdoor_ops *
+vmmouse_get_backdoor(struct psmouse *psmouse)
+{
+#ifdef CONFIG_MOUSE_PS2_VMMOUSE_SIM
+	if (vmmouse_sim_owns_port(psmouse->ps2dev.serio))
+		return &vmmouse_sim_ops;
+#endif
+
+	return &vmmouse_port_ops;
+}
+
+#define VMMOUSE_CMD(psmouse, cmd, in1, out1, out2, out3, out4)		\
+({									\
+	u32 __out[4];							\
+									\
+	vmmouse_get_backdoor(psmouse)->call(VMMOUSE_PROTO_CMD_##cmd,	\
+					    in1, __out);		\
+	out1 = __out[0];						\
+	out2 = __out[1];						\
+	out3 = __out[2];						\
+	out4 = __out[3];						\
 })
 
 /**
@@ -130,39 +179,151 @@ static void vmmouse_report_button(struct psmouse *psmouse,
 }
 
 /**
- * vmmouse_report_events - process events on the vmmouse communications channel
+ * vmmouse_flush_motion - report coalesced motion
  *
  * @psmouse: Pointer to the psmouse struct
  *
- * This function pulls events from the vmmouse communications channel and
- * reports them on the correct (absolute or relative) input device. When the
- * communications channel is drained, or if we've processed more than 255
- * psmouse commands, the function returns PSMOUSE_FULL_PACKET. If there is a
- * host- or synchronization error, the function returns PSMOUSE_BAD_DATA in
- * the hope that the caller will reset the communications channel.
+ * Reports the motion gathered from consecutive motion-only records as a
+ * single input frame on the device it belongs to.
  */
-static psmouse_ret_t vmmouse_report_events(struct psmouse *psmouse)
+static void vmmouse_flush_motion(struct psmouse *psmouse)
 {
+	struct vmmouse_data *priv = psmouse->private;
 	struct input_dev *rel_dev = psmouse->dev;
+	struct input_dev *abs_dev = priv->abs_dev;
+
+	switch (priv->pending) {
+	case VMMOUSE_PENDING_REL:
+		input_report_rel(rel_dev, REL_X, priv->x);
+		input_report_rel(rel_dev, REL_Y, -priv->y);
+		input_sync(rel_dev);
+		break;
+
+	case VMMOUSE_PENDING_ABS:
+		input_report_abs(abs_dev, ABS_X, priv->x);
+		input_report_abs(abs_dev, ABS_Y, priv->y);
+		input_sync(abs_dev);
+		break;
+
+	default:
+		return;
+	}
+
+	priv->pending = 0;
+	priv->frames++;
+}
+
+/**
+ * vmmouse_report_record - report a single record from the vmmouse queue
+ *
+ * @psmouse: Pointer to the psmouse struct
+ * @status:  Status word of the record
+ * @x:       X position or delta
+ * @y:       Y position or delta
+ * @z:       Wheel delta
+ *
+ * Records that only carry motion are merged into the pending motion as
+ * long as they target the same device; anything else flushes the pending
+ * motion and is reported in a frame of its own.
+ */
+static void vmmouse_report_record(struct psmouse *psmouse,
+				  u32 status, u32 x, u32 y, u32 z)
+{
 	struct vmmouse_data *priv = psmouse->private;
+	struct input_dev *rel_dev = psmouse->dev;
 	struct input_dev *abs_dev = priv->abs_dev;
 	struct input_dev *pref_dev;
+	u32 type = status & VMMOUSE_RELATIVE_PACKET ?
+			VMMOUSE_PENDING_REL : VMMOUSE_PENDING_ABS;
+	s8 wheel = -(s8)((u8) z);
+
+	if (!wheel && (status & VMMOUSE_BUTTONS) == priv->buttons &&
+	    (!priv->pending || priv->pending == type)) {
+		if (type == VMMOUSE_PENDING_REL && priv->pending) {
+			priv->x += (s32)x;
+			priv->y += (s32)y;
+		} else {
+			priv->x = x;
+			priv->y = y;
+		}
+		priv->pending = type;
+		return;
+	}
+
+	vmmouse_flush_motion(psmouse);
+
+	/*
+	 * And report what we've got. Prefer to report button
+	 * events on the same device where we report motion events.
+	 * This doesn't work well with the mouse wheel, though. See
+	 * below. Ideally we would want to report that on the
+	 * preferred device as well.
+	 */
+	if (type == VMMOUSE_PENDING_REL) {
+		pref_dev = rel_dev;
+		input_report_rel(rel_dev, REL_X, (s32)x);
+		input_report_rel(rel_dev, REL_Y, -(s32)y);
+	} else {
+		pref_dev = abs_dev;
+		input_report_abs(abs_dev, ABS_X, x);
+		input_report_abs(abs_dev, ABS_Y, y);
+	}
+
+	/* Xorg seems to ignore wheel events on absolute devices */
+	input_report_rel(rel_dev, REL_WHEEL, wheel);
+
+	vmmouse_report_button(psmouse, abs_dev, rel_dev,
+			      pref_dev, BTN_LEFT,
+			      status & VMMOUSE_LEFT_BUTTON);
+	vmmouse_report_button(psmouse, abs_dev, rel_dev,
+			      pref_dev, BTN_RIGHT,
+			      status & VMMOUSE_RIGHT_BUTTON);
+	vmmouse_report_button(psmouse, abs_dev, rel_dev,
+			      pref_dev, BTN_MIDDLE,
+			      status & VMMOUSE_MIDDLE_BUTTON);
+	input_sync(abs_dev);
+	input_sync(rel_dev);
+
+	priv->buttons = status & VMMOUSE_BUTTONS;
+	priv->frames++;
+}
+
+/**
+ * vmmouse_report_events - process events on the vmmouse communications channel
+ *
+ * @psmouse: Pointer to the psmouse struct
+ *
+ * This function pulls events from the vmmouse communications channel and
+ * reports them on the correct (absolute or relative) input device. Each
+ * status call tells how many records are queued, and all of them are read
+ * before the status is checked again. When the communications channel is
+ * drained, or if we've processed more than 255 records, the function
+ * returns PSMOUSE_FULL_PACKET. If there is a host- or synchronization
+ * error, the function returns PSMOUSE_BAD_DATA in the hope that the caller
+ * will reset the communications channel.
+ */
+static psmouse_ret_t vmmouse_report_events(struct psmouse *psmouse)
+{
+	struct vmmouse_data *priv = psmouse->private;
 	u32 status, x, y, z;
 	u32 dummy1, dummy2, dummy3;
 	unsigned int queue_length;
 	unsigned int count = 255;
+	psmouse_ret_t ret = PSMOUSE_FULL_PACKET;
 
-	while (count--) {
+	while (count) {
 		/* See if we have motion data. */
-		VMMOUSE_CMD(ABSPOINTER_STATUS, 0,
+		VMMOUSE_CMD(psmouse, ABSPOINTER_STATUS, 0,
 			    status, dummy1, dummy2, dummy3);
+		priv->backdoor_calls++;
 		if ((status & VMMOUSE_ERROR) == VMMOUSE_ERROR) {
 			psmouse_err(psmouse, "failed to fetch status data\n");
 			/*
 			 * After a few attempts this will result in
 			 * reconnect.
 			 */
-			return PSMOUSE_BAD_DATA;
+			ret = PSMOUSE_BAD_DATA;
+			break;
 		}
 
 		queue_length = status & 0xffff;
@@ -171,46 +332,25 @@ static psmouse_ret_t vmmouse_report_events(struct psmouse *psmouse)
 
 		if (queue_length % 4) {
 			psmouse_err(psmouse, "invalid queue length\n");
-			return PSMOUSE_BAD_DATA;
+			ret = PSMOUSE_BAD_DATA;
+			break;
 		}
 
-		/* Now get it */
-		VMMOUSE_CMD(ABSPOINTER_DATA, 4, status, x, y, z);
-
-		/*
-		 * And report what we've got. Prefer to report button
-		 * events on the same device where we report motion events.
-		 * This doesn't work well with the mouse wheel, though. See
-		 * below. Ideally we would want to report that on the
-		 * preferred device as well.
-		 */
-		if (status & VMMOUSE_RELATIVE_PACKET) {
-			pref_dev = rel_dev;
-			input_report_rel(rel_dev, REL_X, (s32)x);
-			input_report_rel(rel_dev, REL_Y, -(s32)y);
-		} else {
-			pref_dev = abs_dev;
-			input_report_abs(abs_dev, ABS_X, x);
-			input_report_abs(abs_dev, ABS_Y, y);
-		}
+		/* Now get everything that is queued */
+		for (queue_length /= 4; queue_length && count;
+		     queue_length--, count--) {
+			VMMOUSE_CMD(psmouse, ABSPOINTER_DATA, 4,
+				    status, x, y, z);
+			priv->backdoor_calls++;
+			priv->events++;
 
-		/* Xorg seems to ignore wheel events on absolute devices */
-		input_report_rel(rel_dev, REL_WHEEL, -(s8)((u8) z));
-
-		vmmouse_report_button(psmouse, abs_dev, rel_dev,
-				      pref_dev, BTN_LEFT,
-				      status & VMMOUSE_LEFT_BUTTON);
-		vmmouse_report_button(psmouse, abs_dev, rel_dev,
-				      pref_dev, BTN_RIGHT,
-				      status & VMMOUSE_RIGHT_BUTTON);
-		vmmouse_report_button(psmouse, abs_dev, rel_dev,
-				      pref_dev, BTN_MIDDLE,
-				      status & VMMOUSE_MIDDLE_BUTTON);
-		input_sync(abs_dev);
-		input_sync(rel_dev);
+			vmmouse_report_record(psmouse, status, x, y, z);
+		}
 	}
 
-	return PSMOUSE_FULL_PACKET;
+	vmmouse_flush_motion(psmouse);
+
+	return ret;
 }
 
 /**
@@ -252,10 +392,10 @@ static void vmmouse_disable(struct psmouse *psmouse)
 	u32 status;
 	u32 dummy1, dummy2, dummy3, dummy4;
 
-	VMMOUSE_CMD(ABSPOINTER_COMMAND, VMMOUSE_CMD_DISABLE,
+	VMMOUSE_CMD(psmouse, ABSPOINTER_COMMAND, VMMOUSE_CMD_DISABLE,
 		    dummy1, dummy2, dummy3, dummy4);
 
-	VMMOUSE_CMD(ABSPOINTER_STATUS, 0,
+	VMMOUSE_CMD(psmouse, ABSPOINTER_STATUS, 0,
 		    status, dummy1, dummy2, dummy3);
 
 	if ((status & VMMOUSE_ERROR) != VMMOUSE_ERROR)
@@ -280,19 +420,20 @@ static int vmmouse_enable(struct psmouse *psmouse)
 	 * Try enabling the device. If successful, we should be able to
 	 * read valid version ID back from it.
 	 */
-	VMMOUSE_CMD(ABSPOINTER_COMMAND, VMMOUSE_CMD_ENABLE,
+	VMMOUSE_CMD(psmouse, ABSPOINTER_COMMAND, VMMOUSE_CMD_ENABLE,
 		    dummy1, dummy2, dummy3, dummy4);
 
 	/*
 	 * See if version ID can be retrieved.
 	 */
-	VMMOUSE_CMD(ABSPOINTER_STATUS, 0, status, dummy1, dummy2, dummy3);
+	VMMOUSE_CMD(psmouse, ABSPOINTER_STATUS, 0,
+		    status, dummy1, dummy2, dummy3);
 	if ((status & 0x0000ffff) == 0) {
 		psmouse_dbg(psmouse, "empty flags - assuming no device\n");
 		return -ENXIO;
 	}
 
-	VMMOUSE_CMD(ABSPOINTER_DATA, 1 /* single item */,
+	VMMOUSE_CMD(psmouse, ABSPOINTER_DATA, 1 /* single item */,
 		    version, dummy1, dummy2, dummy3);
 	if (version != VMMOUSE_VERSION_ID) {
 		psmouse_dbg(psmouse, "Unexpected version value: %u vs %u\n",
@@ -304,10 +445,10 @@ static int vmmouse_enable(struct psmouse *psmouse)
 	/*
 	 * Restrict ioport access, if possible.
 	 */
-	VMMOUSE_CMD(ABSPOINTER_RESTRICT, VMMOUSE_RESTRICT_CPL0,
+	VMMOUSE_CMD(psmouse, ABSPOINTER_RESTRICT, VMMOUSE_RESTRICT_CPL0,
 		    dummy1, dummy2, dummy3, dummy4);
 
-	VMMOUSE_CMD(ABSPOINTER_COMMAND, VMMOUSE_CMD_REQUEST_ABSOLUTE,
+	VMMOUSE_CMD(psmouse, ABSPOINTER_COMMAND, VMMOUSE_CMD_REQUEST_ABSOLUTE,
 		    dummy1, dummy2, dummy3, dummy4);
 
 	return 0;
@@ -347,24 +488,26 @@ static bool vmmouse_check_hypervisor(void)
  */
 int vmmouse_detect(struct psmouse *psmouse, bool set_properties)
 {
+	const struct vmmouse_backdoor_ops *backdoor = vmmouse_get_backdoor(psmouse);
 	u32 response, version, dummy1, dummy2;
 
-	if (!vmmouse_check_hypervisor()) {
+	if (!backdoor->probe()) {
 		psmouse_dbg(psmouse,
 			    "VMMouse not running on supported hypervisor.\n");
 		return -ENXIO;
 	}
 
-	if (!request_region(VMMOUSE_PROTO_PORT, 4, "vmmouse")) {
-		psmouse_dbg(psmouse, "VMMouse port in use.\n");
+	if (backdoor->request()) {
+		psmouse_dbg(psmouse, "VMMouse %s in use.\n", backdoor->name);
 		return -EBUSY;
 	}
 
 	/* Check if the device is present */
 	response = ~VMMOUSE_PROTO_MAGIC;
-	VMMOUSE_CMD(GETVERSION, 0, version, response, dummy1, dummy2);
+	VMMOUSE_CMD(psmouse, GETVERSION, 0,
+		    version, response, dummy1, dummy2);
 	if (response != VMMOUSE_PROTO_MAGIC || version == 0xffffffffU) {
-		release_region(VMMOUSE_PROTO_PORT, 4);
+		backdoor->release();
 		return -ENXIO;
 	}
 
@@ -374,11 +517,41 @@ int vmmouse_detect(struct psmouse *psmouse, bool set_properties)
 		psmouse->model = version;
 	}
 
-	release_region(VMMOUSE_PROTO_PORT, 4);
+	backdoor->release();
 
 	return 0;
 }
 
+static ssize_t vmmouse_show_counter(struct psmouse *psmouse, void *data,
+				    char *buf)
+{
+	struct vmmouse_data *priv = psmouse->private;
+	unsigned long *counter = (unsigned long *)((char *)priv + (size_t)data);
+
+	return sprintf(buf, "%lu\n", *counter);
+}
+
+PSMOUSE_DEFINE_RO_ATTR(backdoor_calls, S_IRUGO,
+		       (void *)offsetof(struct vmmouse_data, backdoor_calls),
+		       vmmouse_show_counter);
+PSMOUSE_DEFINE_RO_ATTR(events, S_IRUGO,
+		       (void *)offsetof(struct vmmouse_data, events),
+		       vmmouse_show_counter);
+PSMOUSE_DEFINE_RO_ATTR(frames, S_IRUGO,
+		       (void *)offsetof(struct vmmouse_data, frames),
+		       vmmouse_show_counter);
+
+static struct attribute *vmmouse_attrs[] = {
+	&psmouse_attr_backdoor_calls.dattr.attr,
+	&psmouse_attr_events.dattr.attr,
+	&psmouse_attr_frames.dattr.attr,
+	NULL
+};
+
+static struct attribute_group vmmouse_attr_group = {
+	.attrs = vmmouse_attrs,
+};
+
 /**
  * vmmouse_disconnect - Take down vmmouse driver
  *
@@ -390,11 +563,13 @@ static void vmmouse_disconnect(struct psmouse *psmouse)
 {
 	struct vmmouse_data *priv = psmouse->private;
 
+	sysfs_remove_group(&psmouse->ps2dev.serio->dev.kobj,
+			   &vmmouse_attr_group);
 	vmmouse_disable(psmouse);
 	psmouse_reset(psmouse);
 	input_unregister_device(priv->abs_dev);
 	kfree(priv);
-	release_region(VMMOUSE_PROTO_PORT, 4);
+	vmmouse_get_backdoor(psmouse)->release();
 }
 
 /**
@@ -435,11 +610,12 @@ static int vmmouse_reconnect(struct psmouse *psmouse)
 int vmmouse_init(struct psmouse *psmouse)
 {
 	struct vmmouse_data *priv;
+	const struct vmmouse_backdoor_ops *backdoor = vmmouse_get_backdoor(psmouse);
 	struct input_dev *rel_dev = psmouse->dev, *abs_dev;
 	int error;
 
-	if (!request_region(VMMOUSE_PROTO_PORT, 4, "vmmouse")) {
-		psmouse_dbg(psmouse, "VMMouse port in use.\n");
+	if (backdoor->request()) {
+		psmouse_dbg(psmouse, "VMMouse %s in use.\n", backdoor->name);
 		return -EBUSY;
 	}
 
@@ -488,12 +664,24 @@ int vmmouse_init(struct psmouse *psmouse)
 	input_set_abs_params(abs_dev, ABS_X, 0, VMMOUSE_MAX_X, 0, 0);
 	input_set_abs_params(abs_dev, ABS_Y, 0, VMMOUSE_MAX_Y, 0, 0);
 
+	error = sysfs_create_group(&psmouse->ps2dev.serio->dev.kobj,
+				   &vmmouse_attr_group);
+	if (error) {
+		psmouse_err(psmouse,
+			    "failed to create sysfs attributes, error: %d\n",
+			    error);
+		goto unregister_abs;
+	}
+
 	psmouse->protocol_handler = vmmouse_process_byte;
 	psmouse->disconnect = vmmouse_disconnect;
 	psmouse->reconnect = vmmouse_reconnect;
 
 	return 0;
 
+unregister_abs:
+	input_unregister_device(abs_dev);
+	abs_dev = NULL;
 init_fail:
 	vmmouse_disable(psmouse);
 	psmouse_reset(psmouse);
@@ -502,7 +690,7 @@ init_fail:
 	psmouse->private = NULL;
 
 release_region:
-	release_region(VMMOUSE_PROTO_PORT, 4);
+	backdoor->release();
 
 	return error;
 }
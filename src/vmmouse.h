@@ -14,6 +14,49 @@
 #ifdef CONFIG_MOUSE_PS2_VMMOUSE
 #define VMMOUSE_PSNAME  "VirtualPS/2"
 
+#define VMMOUSE_PROTO_MAGIC			0x564D5868U
+
+/*
+ * Main commands supported by the vmmouse hypervisor port.
+ */
+#define VMMOUSE_PROTO_CMD_GETVERSION		10
+#define VMMOUSE_PROTO_CMD_ABSPOINTER_DATA	39
+#define VMMOUSE_PROTO_CMD_ABSPOINTER_STATUS	40
+#define VMMOUSE_PROTO_CMD_ABSPOINTER_COMMAND	41
+#define VMMOUSE_PROTO_CMD_ABSPOINTER_RESTRICT   86
+
+/*
+ * Subcommands for VMMOUSE_PROTO_CMD_ABSPOINTER_COMMAND
+ */
+#define VMMOUSE_CMD_ENABLE			0x45414552U
+#define VMMOUSE_CMD_DISABLE			0x000000f5U
+#define VMMOUSE_CMD_REQUEST_RELATIVE		0x4c455252U
+#define VMMOUSE_CMD_REQUEST_ABSOLUTE		0x53424152U
+
+#define VMMOUSE_ERROR				0xffff0000U
+
+#define VMMOUSE_VERSION_ID			0x3442554aU
+
+#define VMMOUSE_RELATIVE_PACKET			0x00010000U
+
+/**
+ * struct vmmouse_backdoor_ops - transport for the vmmouse protocol
+ *
+ * @name: Short name used in messages.
+ * @probe: Returns true if the transport is usable on this system.
+ * @request: Claims the transport. Returns 0 or a negative error code.
+ * @release: Releases the transport claimed by @request.
+ * @call: Issues @cmd with argument @in1 and stores the four result
+ *	words in @out.
+ */
+struct vmmouse_backdoor_ops {
+	const char *name;
+	bool (*probe)(void);
+	int (*request)(void);
+	void (*release)(void);
+	void (*call)(u32 cmd, u32 in1, u32 *out);
+};
+
 int vmmouse_detect(struct psmouse *psmouse, bool set_properties);
 int vmmouse_init(struct psmouse *psmouse);
 #else
@@ -27,4 +70,19 @@ static inline int vmmouse_init(struct psmouse *psmouse)
 }
 #endif
 
+#ifdef CONFIG_MOUSE_PS2_VMMOUSE_SIM
+extern const struct vmmouse_backdoor_ops vmmouse_sim_ops;
+
+bool vmmouse_sim_owns_port(struct serio *serio);
+void vmmouse_sim_module_init(void);
+void vmmouse_sim_module_exit(void);
+#else
+static inline void vmmouse_sim_module_init(void)
+{
+}
+static inline void vmmouse_sim_module_exit(void)
+{
+}
+#endif
+
 #endif
@@ -0,0 +1,502 @@
+/*
+ * Software stand-in for the VMMouse hypervisor backdoor.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * Emulates the host side of the vmmouse protocol: the version handshake
+ * on enable, the absolute pointer queue and the error status reported
+ * while the device is disabled or broken.  With psmouse.vmmouse_sim set
+ * a dedicated serio port is registered that answers the PS/2 commands
+ * psmouse sends while probing; the vmmouse driver uses this backdoor for
+ * that port only, real ports are never affected.
+ *
+ * Records are fed in through debugfs (vmmouse_sim/):
+ *	queue	 - write "status x y z" to queue one record
+ *	rate	 - records per second queued by the built-in generator,
+ *		   0 stops it
+ *	error	 - non-zero makes every status call fail
+ *	reset	 - write anything to return the host to power-on state
+ *	dropped	 - generated records lost because the queue was full
+ * Every record queued is followed by a PS/2 wake packet on the port, as
+ * the hypervisor does, so the driver's drain and recovery paths run on
+ * machines that are not VMware or KVM guests.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/debugfs.h>
+#include <linux/input.h>
+#include <linux/serio.h>
+#include <linux/libps2.h>
+
+#include "psmouse.h"
+#include "vmmouse.h"
+
+#define VMMOUSE_SIM_VERSION		0x3ff
+#define VMMOUSE_SIM_QUEUE_WORDS		1024	/* power of 2 */
+#define VMMOUSE_SIM_GEN_PERIOD		10	/* ms */
+
+static bool vmmouse_sim;
+module_param(vmmouse_sim, bool, 0444);
+MODULE_PARM_DESC(vmmouse_sim,
+		 "Register a simulated VMMouse port, fed through debugfs.");
+
+static DEFINE_SPINLOCK(vmmouse_sim_lock);
+
+static struct {
+	bool enabled;
+	bool relative;
+	bool error;
+	unsigned int head;
+	unsigned int len;
+	u32 queue[VMMOUSE_SIM_QUEUE_WORDS];
+} vmmouse_sim_host;
+
+/*
+ * PS/2 side of the simulated port.  ps2_mutex keeps wake packets from
+ * landing in the middle of a command response.
+ */
+static DEFINE_MUTEX(vmmouse_sim_ps2_mutex);
+
+static struct serio *vmmouse_sim_serio;
+static bool vmmouse_sim_streaming;
+static unsigned int vmmouse_sim_param_left;
+
+static struct dentry *vmmouse_sim_dir;
+static struct delayed_work vmmouse_sim_gen_work;
+static u32 vmmouse_sim_rate;
+static u32 vmmouse_sim_dropped;
+static u32 vmmouse_sim_gen_pos;
+
+static void vmmouse_sim_push(u32 word)
+{
+	unsigned int tail = (vmmouse_sim_host.head + vmmouse_sim_host.len) &
+				(VMMOUSE_SIM_QUEUE_WORDS - 1);
+
+	vmmouse_sim_host.queue[tail] = word;
+	vmmouse_sim_host.len++;
+}
+
+static u32 vmmouse_sim_pop(void)
+{
+	u32 word;
+
+	if (!vmmouse_sim_host.len)
+		return 0;
+
+	word = vmmouse_sim_host.queue[vmmouse_sim_host.head];
+	vmmouse_sim_host.head = (vmmouse_sim_host.head + 1) &
+				(VMMOUSE_SIM_QUEUE_WORDS - 1);
+	vmmouse_sim_host.len--;
+
+	return word;
+}
+
+static void vmmouse_sim_command(u32 subcmd)
+{
+	switch (subcmd) {
+	case VMMOUSE_CMD_ENABLE:
+		/* The host answers enable with its version ID */
+		vmmouse_sim_host.head = vmmouse_sim_host.len = 0;
+		vmmouse_sim_host.enabled = true;
+		vmmouse_sim_push(VMMOUSE_VERSION_ID);
+		break;
+
+	case VMMOUSE_CMD_DISABLE:
+		vmmouse_sim_host.head = vmmouse_sim_host.len = 0;
+		vmmouse_sim_host.enabled = false;
+		break;
+
+	case VMMOUSE_CMD_REQUEST_RELATIVE:
+		vmmouse_sim_host.relative = true;
+		break;
+
+	case VMMOUSE_CMD_REQUEST_ABSOLUTE:
+		vmmouse_sim_host.relative = false;
+		break;
+	}
+}
+
+static void vmmouse_sim_call(u32 cmd, u32 in1, u32 *out)
+{
+	unsigned long flags;
+	unsigned int i;
+
+	out[0] = out[1] = out[2] = out[3] = 0;
+
+	spin_lock_irqsave(&vmmouse_sim_lock, flags);
+
+	switch (cmd) {
+	case VMMOUSE_PROTO_CMD_GETVERSION:
+		out[0] = VMMOUSE_SIM_VERSION;
+		out[1] = VMMOUSE_PROTO_MAGIC;
+		break;
+
+	case VMMOUSE_PROTO_CMD_ABSPOINTER_COMMAND:
+		vmmouse_sim_command(in1);
+		break;
+
+	case VMMOUSE_PROTO_CMD_ABSPOINTER_STATUS:
+		if (vmmouse_sim_host.error || !vmmouse_sim_host.enabled)
+			out[0] = VMMOUSE_ERROR;
+		else
+			out[0] = vmmouse_sim_host.len;
+		break;
+
+	case VMMOUSE_PROTO_CMD_ABSPOINTER_DATA:
+		for (i = 0; i < min_t(u32, in1, 4); i++)
+			out[i] = vmmouse_sim_pop();
+		break;
+
+	case VMMOUSE_PROTO_CMD_ABSPOINTER_RESTRICT:
+		break;
+
+	default:
+		out[0] = 0xffffffffU;
+		break;
+	}
+
+	spin_unlock_irqrestore(&vmmouse_sim_lock, flags);
+}
+
+/* Only ever reached for the simulated port, see vmmouse_sim_owns_port() */
+static bool vmmouse_sim_probe(void)
+{
+	return true;
+}
+
+static int vmmouse_sim_request(void)
+{
+	return 0;
+}
+
+static void vmmouse_sim_release(void)
+{
+}
+
+const struct vmmouse_backdoor_ops vmmouse_sim_ops = {
+	.name		= "simulator",
+	.probe		= vmmouse_sim_probe,
+	.request	= vmmouse_sim_request,
+	.release	= vmmouse_sim_release,
+	.call		= vmmouse_sim_call,
+};
+
+/**
+ * vmmouse_sim_owns_port - check whether a serio port is the simulated one
+ *
+ * @serio: Port psmouse is bound to
+ */
+bool vmmouse_sim_owns_port(struct serio *serio)
+{
+	return serio && serio == vmmouse_sim_serio;
+}
+
+static void vmmouse_sim_reset(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&vmmouse_sim_lock, flags);
+	vmmouse_sim_host.enabled = false;
+	vmmouse_sim_host.relative = false;
+	vmmouse_sim_host.error = false;
+	vmmouse_sim_host.head = vmmouse_sim_host.len = 0;
+	spin_unlock_irqrestore(&vmmouse_sim_lock, flags);
+}
+
+/*
+ * Add a record to the simulated absolute pointer queue.  Returns 0 on
+ * success, -ENODEV if the device is not enabled and -ENOSPC if the
+ * queue is full.
+ */
+static int vmmouse_sim_queue(u32 status, u32 x, u32 y, u32 z)
+{
+	unsigned long flags;
+	int error = 0;
+
+	spin_lock_irqsave(&vmmouse_sim_lock, flags);
+
+	if (!vmmouse_sim_host.enabled) {
+		error = -ENODEV;
+	} else if (vmmouse_sim_host.len + 4 > VMMOUSE_SIM_QUEUE_WORDS) {
+		error = -ENOSPC;
+	} else {
+		if (vmmouse_sim_host.relative)
+			status |= VMMOUSE_RELATIVE_PACKET;
+
+		vmmouse_sim_push(status);
+		vmmouse_sim_push(x);
+		vmmouse_sim_push(y);
+		vmmouse_sim_push(z);
+	}
+
+	spin_unlock_irqrestore(&vmmouse_sim_lock, flags);
+
+	return error;
+}
+
+/*
+ * Tell the driver there is data, the same way the hypervisor does: with
+ * a standard 3-byte packet on the PS/2 channel.  The driver drains the
+ * queue from its protocol handler, which calls back into
+ * vmmouse_sim_call(), so vmmouse_sim_lock must not be held here.
+ */
+static void vmmouse_sim_wake(void)
+{
+	static const unsigned char wake[] = { 0x08, 0x00, 0x00 };
+	int i;
+
+	mutex_lock(&vmmouse_sim_ps2_mutex);
+
+	if (vmmouse_sim_serio && vmmouse_sim_streaming)
+		for (i = 0; i < ARRAY_SIZE(wake); i++)
+			serio_interrupt(vmmouse_sim_serio, wake[i], 0);
+
+	mutex_unlock(&vmmouse_sim_ps2_mutex);
+}
+
+/*
+ * Answers PS/2 commands like a plain mouse, synchronously from the
+ * write: the ACK, then whatever the command returns.
+ */
+static int vmmouse_sim_serio_write(struct serio *serio, unsigned char byte)
+{
+	unsigned char reply[4] = { PSMOUSE_RET_ACK };
+	int count = 1;
+	int i;
+
+	mutex_lock(&vmmouse_sim_ps2_mutex);
+
+	if (vmmouse_sim_param_left) {
+		vmmouse_sim_param_left--;
+	} else {
+		switch (byte) {
+		case PSMOUSE_CMD_SETRES & 0xff:
+		case PSMOUSE_CMD_SETRATE & 0xff:
+			vmmouse_sim_param_left = 1;
+			break;
+
+		case PSMOUSE_CMD_GETID & 0xff:
+			reply[count++] = PSMOUSE_RET_ID;
+			break;
+
+		case PSMOUSE_CMD_GETINFO & 0xff:
+			/* Stream mode, 4 counts/mm, 100 samples/s */
+			reply[count++] = 0x00;
+			reply[count++] = 0x02;
+			reply[count++] = 100;
+			break;
+
+		case PSMOUSE_CMD_POLL & 0xff:
+			reply[count++] = 0x08;
+			reply[count++] = 0x00;
+			reply[count++] = 0x00;
+			break;
+
+		case PSMOUSE_CMD_ENABLE & 0xff:
+			vmmouse_sim_streaming = true;
+			break;
+
+		case PSMOUSE_CMD_DISABLE & 0xff:
+		case PSMOUSE_CMD_RESET_DIS & 0xff:
+			vmmouse_sim_streaming = false;
+			break;
+
+		case PSMOUSE_CMD_RESET_BAT & 0xff:
+			vmmouse_sim_streaming = false;
+			reply[count++] = PSMOUSE_RET_BAT;
+			reply[count++] = PSMOUSE_RET_ID;
+			break;
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		serio_interrupt(serio, reply[i], 0);
+
+	mutex_unlock(&vmmouse_sim_ps2_mutex);
+
+	return 0;
+}
+
+static ssize_t vmmouse_sim_queue_write(struct file *file,
+				       const char __user *ubuf,
+				       size_t count, loff_t *ppos)
+{
+	int status, x, y, z;
+	char *buf;
+	int error;
+
+	buf = memdup_user_nul(ubuf, min_t(size_t, count, 64));
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+
+	if (sscanf(buf, "%i %i %i %i", &status, &x, &y, &z) != 4)
+		error = -EINVAL;
+	else
+		error = vmmouse_sim_queue(status, x, y, z);
+
+	kfree(buf);
+
+	if (error)
+		return error;
+
+	vmmouse_sim_wake();
+
+	return count;
+}
+
+static const struct file_operations vmmouse_sim_queue_fops = {
+	.owner	= THIS_MODULE,
+	.open	= simple_open,
+	.write	= vmmouse_sim_queue_write,
+	.llseek	= noop_llseek,
+};
+
+static int vmmouse_sim_error_get(void *data, u64 *val)
+{
+	*val = vmmouse_sim_host.error;
+	return 0;
+}
+
+static int vmmouse_sim_error_set(void *data, u64 val)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&vmmouse_sim_lock, flags);
+	vmmouse_sim_host.error = val != 0;
+	spin_unlock_irqrestore(&vmmouse_sim_lock, flags);
+
+	/* Let the driver see the failing status right away */
+	if (val)
+		vmmouse_sim_wake();
+
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(vmmouse_sim_error_fops, vmmouse_sim_error_get,
+			vmmouse_sim_error_set, "%llu\n");
+
+static int vmmouse_sim_reset_set(void *data, u64 val)
+{
+	vmmouse_sim_reset();
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(vmmouse_sim_reset_fops, NULL,
+			vmmouse_sim_reset_set, "%llu\n");
+
+/*
+ * The generator queues rate/100 records (at least one) every 10ms, a
+ * diagonal sweep in absolute mode or one-count steps in relative mode,
+ * and wakes the driver once per batch.
+ */
+static void vmmouse_sim_gen_work_fn(struct work_struct *work)
+{
+	u32 rate = READ_ONCE(vmmouse_sim_rate);
+	unsigned int i, n;
+	u32 pos;
+
+	if (!rate)
+		return;
+
+	n = DIV_ROUND_UP(rate, 1000 / VMMOUSE_SIM_GEN_PERIOD);
+	for (i = 0; i < n; i++) {
+		pos = vmmouse_sim_host.relative ? 1 :
+			(vmmouse_sim_gen_pos += 0x40) & 0xffff;
+		if (vmmouse_sim_queue(0, pos, pos, 0)) {
+			vmmouse_sim_dropped += n - i;
+			break;
+		}
+	}
+
+	vmmouse_sim_wake();
+
+	schedule_delayed_work(&vmmouse_sim_gen_work,
+			      msecs_to_jiffies(VMMOUSE_SIM_GEN_PERIOD));
+}
+
+static int vmmouse_sim_rate_get(void *data, u64 *val)
+{
+	*val = vmmouse_sim_rate;
+	return 0;
+}
+
+static int vmmouse_sim_rate_set(void *data, u64 val)
+{
+	WRITE_ONCE(vmmouse_sim_rate, min_t(u64, val, U32_MAX));
+
+	if (val)
+		mod_delayed_work(system_wq, &vmmouse_sim_gen_work, 0);
+	else
+		cancel_delayed_work_sync(&vmmouse_sim_gen_work);
+
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(vmmouse_sim_rate_fops, vmmouse_sim_rate_get,
+			vmmouse_sim_rate_set, "%llu\n");
+
+/**
+ * vmmouse_sim_module_init - register the simulated port if requested
+ *
+ * The port is a plain i8042-type serio port, so psmouse binds to it
+ * and vmmouse_detect() finds the simulated backdoor behind it.
+ */
+void vmmouse_sim_module_init(void)
+{
+	struct serio *serio;
+
+	if (!vmmouse_sim)
+		return;
+
+	INIT_DELAYED_WORK(&vmmouse_sim_gen_work, vmmouse_sim_gen_work_fn);
+
+	serio = kzalloc(sizeof(*serio), GFP_KERNEL);
+	if (!serio) {
+		pr_err("vmmouse_sim: failed to allocate serio port\n");
+		return;
+	}
+
+	serio->id.type = SERIO_8042;
+	serio->write = vmmouse_sim_serio_write;
+	strlcpy(serio->name, "VMMouse simulator", sizeof(serio->name));
+	strlcpy(serio->phys, "vmmouse-sim/serio0", sizeof(serio->phys));
+
+	vmmouse_sim_dir = debugfs_create_dir("vmmouse_sim", NULL);
+	debugfs_create_file("queue", 0200, vmmouse_sim_dir, NULL,
+			    &vmmouse_sim_queue_fops);
+	debugfs_create_file("rate", 0600, vmmouse_sim_dir, NULL,
+			    &vmmouse_sim_rate_fops);
+	debugfs_create_file("error", 0600, vmmouse_sim_dir, NULL,
+			    &vmmouse_sim_error_fops);
+	debugfs_create_file("reset", 0200, vmmouse_sim_dir, NULL,
+			    &vmmouse_sim_reset_fops);
+	debugfs_create_u32("dropped", 0400, vmmouse_sim_dir,
+			   &vmmouse_sim_dropped);
+
+	vmmouse_sim_serio = serio;
+	serio_register_port(serio);
+}
+
+/**
+ * vmmouse_sim_module_exit - tear down the simulated port
+ */
+void vmmouse_sim_module_exit(void)
+{
+	if (!vmmouse_sim_serio)
+		return;
+
+	debugfs_remove_recursive(vmmouse_sim_dir);
+	WRITE_ONCE(vmmouse_sim_rate, 0);
+	cancel_delayed_work_sync(&vmmouse_sim_gen_work);
+
+	/* Disconnects psmouse from the port and frees it */
+	serio_unregister_port(vmmouse_sim_serio);
+	vmmouse_sim_serio = NULL;
+}